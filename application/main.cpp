@@ -127,6 +127,10 @@ int main(int argc, char *argv[])
         haveUsername = true;
         havePasswd   = true;
       }
+      else if (argument.contains("-resume"))
+        csvimpInterface->setResume(true);
+      else if (argument.contains("-parsePolicy="))
+        csvimpInterface->setParsePolicy(argument.mid(argument.indexOf('=') + 1));
 
     }
 
@@ -11,6 +11,7 @@
 #ifndef __CSVIMPPLUGININTERFACE_H__
 #define __CSVIMPPLUGININTERFACE_H__
 
+class QIODevice;
 class QMainWindow;
 
 class CSVImpPluginInterface
@@ -25,13 +26,17 @@ class CSVImpPluginInterface
     virtual QString lastError()      = 0;
     virtual bool    openAtlas(QString filename = QString(), bool useDb = false) = 0;
     virtual bool    openCSV(QString filename = QString())   = 0;
+    virtual bool    openCSV(QIODevice *device, QString name = QString()) = 0;
     virtual void    setAtlasDir(QString dirname)            = 0;
     virtual bool    setAtlasMap(const QString dirname)      = 0;
     virtual void    setCSVDir(QString dirname)              = 0;
+    virtual void    setCommitInterval(int rows, int seconds = 0) = 0;
     virtual bool    setFirstLineHeader(bool isheader)       = 0;
     virtual void    setInteractive(bool isinteractive)      = 0;
+    virtual void    setParsePolicy(QString policy)          = 0;
+    virtual void    setResume(bool resume)                  = 0;
 };
 
 Q_DECLARE_INTERFACE(CSVImpPluginInterface,
-                    "org.xtuple.Plugin.CSVImpPluginInterface/0.4");
+                    "org.xtuple.Plugin.CSVImpPluginInterface/0.8");
 #endif
@@ -0,0 +1,210 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvarraywriter.h"
+
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+
+#define DEBUG false
+
+CSVArrayWriter::CSVArrayWriter(CSVImportPlan *plan, int batchSize)
+  : CSVImportWriter(plan, batchSize > 0 ? batchSize : int(DefaultBatchSize))
+{
+}
+
+CSVArrayWriter::~CSVArrayWriter()
+{
+  QHash<QBitArray, QSqlQuery*>::iterator it;
+  for (it = _statements.begin(); it != _statements.end(); ++it)
+    delete it.value();
+}
+
+void CSVArrayWriter::reconnected()
+{
+  CSVImportWriter::reconnected();
+  qDeleteAll(_statements);
+  _statements.clear();
+}
+
+// a failing statement fails the whole batch, so a single row needs the
+// batch's savepoint
+bool CSVArrayWriter::rowSavepoints() const
+{
+  return false;
+}
+
+bool CSVArrayWriter::writeBatch(const QList<CSVImportRow> &rows, QString *errmsg)
+{
+  const QBitArray &omitted = rows.first().omitted;
+  QSqlQuery *qry = statement(omitted, errmsg);
+  if (! qry)
+    return false;
+
+  int b = 0;
+  for (int c = 0; c < _plan->columnCount(); c++)
+    if (! omitted.testBit(c))
+      qry->bindValue(b++, arrayLiteral(rows, c));
+  qry->bindValue(b, arrayLiteral(rows, -1));
+
+  if (! qry->exec())
+  {
+    if (errmsg)
+      *errmsg = qry->lastError().text();
+    return false;
+  }
+
+  int unchanged = 0;
+  if (_plan->action() == CSVMap::Append)
+  {
+    unchanged = rows.size() - qry->numRowsAffected();
+    _skipped += unchanged;
+  }
+  else if (_plan->action() == CSVMap::Update)
+  {
+    while (qry->next())
+    {
+      ignore(qry->value(0).toInt(),
+             QString("IGNORED Record %1: There is no record to update")
+               .arg(qry->value(0).toInt() + 1));
+      unchanged++;
+    }
+  }
+
+  _written += rows.size() - unchanged;
+  return true;
+}
+
+/* The values of column col of every row as an array literal, every element
+   quoted so the server parses it by the column's type. A col of -1 gives
+   the rows' numbers instead.
+ */
+QString CSVArrayWriter::arrayLiteral(const QList<CSVImportRow> &rows, int col) const
+{
+  QString literal("{");
+  for (int r = 0; r < rows.size(); r++)
+  {
+    if (r > 0)
+      literal.append(',');
+    if (col < 0)
+    {
+      literal.append(QString::number(rows.at(r).row));
+      continue;
+    }
+
+    const QVariant &value = rows.at(r).values.at(col);
+    if (value.isNull())
+    {
+      literal.append("NULL");
+      continue;
+    }
+
+    QString element;
+    if (value.type() == QVariant::ByteArray)
+      element = "\\x" + QString::fromLatin1(value.toByteArray().toHex());
+    else
+      element = value.toString();
+    element.replace('\\', "\\\\").replace('"', "\\\"");
+    literal.append('"').append(element).append('"');
+  }
+  literal.append('}');
+
+  return literal;
+}
+
+QString CSVArrayWriter::keyMatch(const QBitArray &omitted, const QString &target,
+                                 const QString &source) const
+{
+  QStringList match;
+  for (int c = 0; c < _plan->columnCount(); c++)
+    if (_plan->isKey(c) && ! omitted.testBit(c))
+      match.append(QString("%1.%3 = %2.%3").arg(target, source, _plan->columnName(c)));
+  return match.join(" AND ");
+}
+
+/* Rows repeating a key within a batch are applied once: Update and Upsert
+   keep the last of them and Append the first, as writing one row at a time
+   would. The Update statement returns the rows that matched nothing.
+ */
+QSqlQuery *CSVArrayWriter::statement(const QBitArray &omitted, QString *errmsg)
+{
+  if (_statements.contains(omitted))
+    return _statements.value(omitted);
+
+  QStringList arrays;
+  QStringList names;
+  QStringList keys;
+  QStringList sets;
+  for (int c = 0; c < _plan->columnCount(); c++)
+  {
+    if (omitted.testBit(c))
+      continue;
+    arrays.append(QString("CAST(? AS %1[])").arg(_plan->columnType(c)));
+    names.append(_plan->columnName(c));
+    if (_plan->isKey(c))
+      keys.append(_plan->columnName(c));
+    else
+      sets.append(QString("%1 = v.%1").arg(_plan->columnName(c)));
+  }
+  arrays.append("CAST(? AS integer[])");
+
+  QString source = QString("unnest(%1) AS s(%2, csvimp_row)")
+                     .arg(arrays.join(", "), names.join(", "));
+  QString sql;
+  switch (_plan->action())
+  {
+    case CSVMap::Update:
+      sql = QString("WITH s AS (SELECT * FROM %1),"
+                    "     u AS (UPDATE %2 AS t SET %3"
+                    "             FROM (SELECT DISTINCT ON (%4) * FROM s"
+                    "                    ORDER BY %4, csvimp_row DESC) AS v"
+                    "            WHERE %5)"
+                    " SELECT csvimp_row FROM s"
+                    "  WHERE NOT EXISTS (SELECT 1 FROM %2 AS t WHERE %6)"
+                    "  ORDER BY csvimp_row;")
+              .arg(source, _plan->table(), sets.join(", "), keys.join(", "),
+                   keyMatch(omitted, "t", "v"), keyMatch(omitted, "t", "s"));
+      break;
+    case CSVMap::Append:
+      sql = QString("INSERT INTO %1 (%2)"
+                    " SELECT DISTINCT ON (s.%3) s.%4 FROM %5"
+                    "  WHERE NOT EXISTS (SELECT 1 FROM %1 AS t WHERE %6)"
+                    "  ORDER BY s.%3, s.csvimp_row;")
+              .arg(_plan->table(), names.join(", "), keys.join(", s."),
+                   names.join(", s."), source, keyMatch(omitted, "t", "s"));
+      break;
+    case CSVMap::Upsert:
+      sql = QString("INSERT INTO %1 (%2)"
+                    " SELECT DISTINCT ON (s.%3) s.%4 FROM %5"
+                    "  ORDER BY s.%3, s.csvimp_row DESC%6;")
+              .arg(_plan->table(), names.join(", "), keys.join(", s."),
+                   names.join(", s."), source, _plan->conflictClause(omitted));
+      break;
+    default:
+      sql = QString("INSERT INTO %1 (%2) SELECT s.%3 FROM %4;")
+              .arg(_plan->table(), names.join(", "), names.join(", s."), source);
+  }
+
+  if (DEBUG)
+    qDebug("CSVArrayWriter::statement() preparing %s", qPrintable(sql));
+
+  QSqlQuery *qry = new QSqlQuery(_plan->database());
+  if (! qry->prepare(sql))
+  {
+    if (errmsg)
+      *errmsg = qry->lastError().text();
+    delete qry;
+    return 0;
+  }
+
+  _statements.insert(omitted, qry);
+  return qry;
+}
@@ -0,0 +1,47 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVARRAYWRITER_H__
+#define __CSVARRAYWRITER_H__
+
+#include <QBitArray>
+#include <QHash>
+
+#include "csvimportwriter.h"
+
+class QSqlQuery;
+
+/* Writes a batch with one statement binding one array per column, which
+   unnest() turns back into rows. Unlike VALUES the statement does not grow
+   with the batch, so one prepared statement serves every batch of a shape,
+   and unlike COPY it works where only plain statements are allowed, such
+   as through a pooler in transaction mode.
+ */
+class CSVArrayWriter : public CSVImportWriter
+{
+  public:
+    static const int DefaultBatchSize = 5000;
+
+    CSVArrayWriter(CSVImportPlan *plan, int batchSize = 0);
+    virtual ~CSVArrayWriter();
+
+  protected:
+    virtual bool writeBatch(const QList<CSVImportRow> &rows, QString *errmsg);
+    virtual bool rowSavepoints() const;
+    virtual void reconnected();
+    QString      arrayLiteral(const QList<CSVImportRow> &rows, int col) const;
+    QString      keyMatch(const QBitArray &omitted, const QString &target,
+                          const QString &source) const;
+    QSqlQuery   *statement(const QBitArray &omitted, QString *errmsg);
+
+    QHash<QBitArray, QSqlQuery*> _statements;
+};
+
+#endif
@@ -221,11 +221,12 @@ void CSVAtlasWindow::fileSave()
   if(fi.suffix() != "xml")
     _filename = _filename + ".xml";
 
-  if (tr("Update") == _action->currentText() || tr("Append") == _action->currentText())
+  if (tr("Update") == _action->currentText() || tr("Append") == _action->currentText() ||
+      tr("Upsert") == _action->currentText())
   {
     if (!hasKey())
     {
-      _msghandler->message(QtWarningMsg, tr("You must specify Key field(s) with action Update/Append"));
+      _msghandler->message(QtWarningMsg, tr("You must specify Key field(s) with action Update/Append/Upsert"));
       return;
     }
   }
@@ -270,11 +271,12 @@ void CSVAtlasWindow::dbSave()
     return;
   }
 
-  if (tr("Update") == _action->currentText() || tr("Append") == _action->currentText())
+  if (tr("Update") == _action->currentText() || tr("Append") == _action->currentText() ||
+      tr("Upsert") == _action->currentText())
   {
     if (!hasKey())
     {
-      _msghandler->message(QtWarningMsg, tr("You must specify Key field(s) with action Update/Append"));
+      _msghandler->message(QtWarningMsg, tr("You must specify Key field(s) with action Update/Append/Upsert"));
       return;
     }
   }
@@ -451,6 +453,12 @@ void CSVAtlasWindow::sMapChanged( int )
       map.setAction(CSVMap::Update);
     else if(tr("Append") == _action->currentText())
       map.setAction(CSVMap::Append);
+    else if(tr("Upsert") == _action->currentText())
+      map.setAction(CSVMap::Upsert);
+    map.setMethod(CSVMap::Method(_method->currentIndex()));
+    map.setBatchSize(_batchSize->value());
+    map.setConnections(_connections->value());
+    map.setCommitInterval(_commitRows->value(), _commitSeconds->value());
     map.setDelimiter(_delimiter->currentText());
     map.setDescription(_description->toPlainText());
     map.setSqlPre(_preSql->toPlainText().trimmed());
@@ -520,6 +528,11 @@ void CSVAtlasWindow::sMapChanged( int )
       _table->setEnabled(true);
 
       _action->setCurrentIndex(map.action());
+      _method->setCurrentIndex(map.method());
+      _batchSize->setValue(map.batchSize());
+      _connections->setValue(map.connections());
+      _commitRows->setValue(map.commitRows());
+      _commitSeconds->setValue(map.commitSeconds());
       _description->setText(map.description());
 
       int delimidx = _delimiter->findText(map.delimiter());
@@ -0,0 +1,210 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvattachmentloader.h"
+
+#include <QBuffer>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageWriter>
+#include <QMimeDatabase>
+#include <QMutexLocker>
+
+#include <quuencode.h>
+
+#include "csvimportplan.h"
+
+#define DEBUG false
+
+CSVAttachmentLoader::CSVAttachmentLoader(const CSVImportPlan *plan)
+  : _cache(CacheBytes),
+    _needed(false),
+    _plan(plan)
+{
+  for (int i = 0; i < _plan->columnCount(); i++)
+    if (_plan->fileType(i) != CSVMapField::TYPE_NA)
+      _needed = true;
+}
+
+void CSVAttachmentLoader::load(CSVImportRow &row) const
+{
+  if (! _needed)
+    return;
+
+  QMimeDatabase mimedb;
+  QString mimetype;
+  for (int i = 0; i < _plan->columnCount(); i++)
+  {
+    CSVMapField::FileType filetype = _plan->fileType(i);
+    if (filetype == CSVMapField::TYPE_NA || row.values.at(i).isNull())
+      continue;
+
+    QString  fileName = row.values.at(i).toString();
+    QString  errmsg;
+    QVariant var      = cached(fileName, filetype, &errmsg);
+    if (filetype == CSVMapField::TYPE_FILE && ! var.isNull())
+      mimetype = mimedb.mimeTypeForFile(QFileInfo(fileName)).name();
+
+    if (var.isNull())
+    {
+      var = QVariant(QString {}); // Nothing (error)
+      row.warnings.append(QString("WARNING Record %1: %2").arg(row.row + 1).arg(errmsg));
+    }
+    row.values[i] = var;
+  }
+
+  if (_plan->mimeTypeColumn() >= 0 && ! mimetype.isEmpty())
+  {
+    row.values[_plan->mimeTypeColumn()] = mimetype;
+    row.omitted.clearBit(_plan->mimeTypeColumn());
+  }
+}
+
+/* Load a file, or take it from the cache if the same file was loaded the
+   same way before and has not changed since. Failures are not kept, so
+   each row naming a missing file gets its own warning.
+ */
+QVariant CSVAttachmentLoader::cached(const QString &fileName,
+                                     CSVMapField::FileType filetype,
+                                     QString *errmsg) const
+{
+  QFileInfo fi(fileName);
+  QString   key;
+  if (fi.isFile())
+  {
+    key = QString("%1|%2|%3|%4").arg(filetype).arg(fi.size())
+            .arg(fi.lastModified().toMSecsSinceEpoch()).arg(fi.absoluteFilePath());
+    QMutexLocker lock(&_mutex);
+    if (QVariant *var = _cache.object(key))
+      return *var;
+  }
+
+  QVariant var;
+  switch (filetype)
+  {
+    case CSVMapField::TYPE_IMAGE:
+    case CSVMapField::TYPE_IMAGEENC:
+      var = loadImage(fileName, filetype == CSVMapField::TYPE_IMAGEENC, errmsg);
+      break;
+    case CSVMapField::TYPE_FILE:
+      var = loadDocument(fileName, errmsg);
+      break;
+    default:
+      return QVariant();
+  }
+
+  if (! key.isEmpty() && ! var.isNull())
+  {
+    int cost = var.type() == QVariant::String ? var.toString().size() * 2
+                                               : var.toByteArray().size();
+    if (DEBUG)
+      qDebug("CSVAttachmentLoader::cached() keeping %s (%d bytes)",
+             qPrintable(fileName), cost);
+    QMutexLocker lock(&_mutex);
+    _cache.insert(key, new QVariant(var), cost);
+  }
+
+  return var;
+}
+
+// the contents of a file, or a null QVariant if it cannot be read
+QVariant CSVAttachmentLoader::loadDocument(const QString &fileName, QString *errmsg)
+{
+  QFileInfo fi(fileName);
+  if (! fi.exists())
+  {
+    if (errmsg)
+      *errmsg = QString("File %1 was not found and will not be saved.").arg(fileName);
+    return QVariant();
+  }
+
+  QFile sourceFile(fileName);
+  if (! sourceFile.open(QIODevice::ReadOnly))
+  {
+    if (errmsg)
+      *errmsg = QString("Could not open source file %1 for read.").arg(fileName);
+    return QVariant();
+  }
+
+  return QVariant(sourceFile.readAll());
+}
+
+/* Whether bytes hold a whole PNG file: the signature, the IHDR chunk that
+   must come first and the IEND chunk that must come last. This does not
+   check the image data but is enough to tell a PNG from other formats and
+   from files cut short.
+ */
+bool CSVAttachmentLoader::isPng(const QByteArray &bytes)
+{
+  static const QByteArray head("\x89PNG\r\n\x1a\n\0\0\0\x0dIHDR", 16);
+  static const QByteArray tail("\0\0\0\0IEND\xae\x42\x60\x82", 12);
+
+  return bytes.size() >= head.size() + 17 + tail.size() &&
+         bytes.startsWith(head) && bytes.endsWith(tail);
+}
+
+/* An image converted to PNG, or a null QVariant if it cannot be loaded.
+   Files that already are PNGs are used as they are, skipping the decode
+   and compression.
+ */
+QVariant CSVAttachmentLoader::loadImage(const QString &fileName, bool enc, QString *errmsg)
+{
+  QImage image;
+  if (fileName.length() <= 1)
+  {
+    if (errmsg)
+      *errmsg = QString("No image was specified.");
+    return QVariant();
+  }
+
+  QBuffer imageBuffer;
+  QFile   sourceFile(fileName);
+  if (sourceFile.open(QIODevice::ReadOnly) && sourceFile.peek(8) == "\x89PNG\r\n\x1a\n")
+  {
+    QByteArray bytes = sourceFile.readAll();
+    if (isPng(bytes))
+      imageBuffer.setData(bytes);
+    else if (DEBUG)
+      qDebug("CSVAttachmentLoader::loadImage() %s is not a complete PNG",
+             qPrintable(fileName));
+  }
+  sourceFile.close();
+
+  if (imageBuffer.data().isEmpty())
+  {
+    if (! image.load(fileName))
+    {
+      if (errmsg)
+        *errmsg = QString("Could not load file %1. The file is not an image, "
+                          "an unknown image format or is corrupt").arg(fileName);
+      return QVariant();
+    }
+
+    QImageWriter imageIo;
+    imageBuffer.open(QIODevice::ReadWrite);
+    imageIo.setDevice(&imageBuffer);
+    imageIo.setFormat("PNG");
+
+    if (! imageIo.write(image))
+    {
+      if (errmsg)
+        *errmsg = QString("There was an error trying to save the image (%1).").arg(fileName);
+      return QVariant();
+    }
+
+    imageBuffer.close();
+  }
+
+  QString imageString = enc ? QUUEncode(imageBuffer) : imageBuffer.buffer();
+
+  return QVariant(imageString);
+}
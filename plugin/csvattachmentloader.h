@@ -0,0 +1,59 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVATTACHMENTLOADER_H__
+#define __CSVATTACHMENTLOADER_H__
+
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <QString>
+#include <QVariant>
+
+#include "csvmap.h"
+
+class CSVImportPlan;
+class CSVImportRow;
+
+/* Replaces the file names a CSVImportPlan leaves in the columns it fills
+   from data files with the files' contents: images converted to PNG and
+   optionally UU encoded, other documents as they are, along with their
+   MIME type. Nothing here touches the GUI, so rows can be loaded on any
+   thread; files that cannot be loaded are noted in the row's warnings.
+   Many rows often name the same file, so loaded files are kept, up to
+   CacheBytes, keyed by path, size and modification time; rows naming a
+   kept file share its contents instead of reading and encoding it again.
+ */
+class CSVAttachmentLoader
+{
+  public:
+    static const int CacheBytes = 64 * 1024 * 1024;
+
+    CSVAttachmentLoader(const CSVImportPlan *plan);
+
+    bool isNeeded() const { return _needed; }
+    void load(CSVImportRow &row) const;
+
+    static QVariant loadDocument(const QString &fileName, QString *errmsg);
+    static QVariant loadImage(const QString &fileName, bool enc, QString *errmsg);
+
+  protected:
+    static bool isPng(const QByteArray &bytes);
+
+    QVariant cached(const QString &fileName, CSVMapField::FileType filetype,
+                    QString *errmsg) const;
+
+    mutable QCache<QString, QVariant> _cache;
+    mutable QMutex       _mutex;
+    bool                 _needed;
+    const CSVImportPlan *_plan;
+};
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvbinarycopywriter.h"
+
+#include <QDate>
+#include <QDateTime>
+#include <QRegularExpression>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtEndian>
+
+#include <string.h>
+
+#define DEBUG false
+
+// a range of a batch's rows, encoded by one worker thread
+class CSVBinaryChunk
+{
+  public:
+    const QList<CSVImportRow>                 *rows;
+    const QVector<int>                        *columns;
+    const QVector<CSVBinaryCopyWriter::Kind>  *kinds;
+    int        begin;
+    int        end;
+    QByteArray data;
+    QString    error;
+};
+
+static const QDate     pgEpochDate(2000, 1, 1);
+static const QDateTime pgEpoch(QDate(2000, 1, 1), QTime(0, 0), Qt::UTC);
+
+static void putInt16(QByteArray &buffer, qint16 value)
+{
+  char bytes[2];
+  qToBigEndian(value, reinterpret_cast<uchar *>(bytes));
+  buffer.append(bytes, 2);
+}
+
+static void putInt32(QByteArray &buffer, qint32 value)
+{
+  char bytes[4];
+  qToBigEndian(value, reinterpret_cast<uchar *>(bytes));
+  buffer.append(bytes, 4);
+}
+
+static void putInt64(QByteArray &buffer, qint64 value)
+{
+  char bytes[8];
+  qToBigEndian(value, reinterpret_cast<uchar *>(bytes));
+  buffer.append(bytes, 8);
+}
+
+/* numeric is sent as base 10000 digits with a weight (the power of 10000 of
+   the first digit), a sign and a display scale.
+ */
+static bool putNumeric(QByteArray &buffer, const QString &text)
+{
+  QString str = text.trimmed();
+  quint16 sign = 0x0000;
+  if (str.startsWith('-') || str.startsWith('+'))
+  {
+    if (str.startsWith('-'))
+      sign = 0x4000;
+    str.remove(0, 1);
+  }
+
+  int point = str.indexOf('.');
+  QString intpart  = point < 0 ? str : str.left(point);
+  QString fracpart = point < 0 ? QString {} : str.mid(point + 1);
+  if (intpart.isEmpty() && fracpart.isEmpty())
+    return false;
+  for (int i = 0; i < intpart.size(); i++)
+    if (! intpart.at(i).isDigit())
+      return false;
+  for (int i = 0; i < fracpart.size(); i++)
+    if (! fracpart.at(i).isDigit())
+      return false;
+
+  qint16 dscale = fracpart.size();
+  intpart  = QString((4 - intpart.size() % 4) % 4, '0') + intpart;
+  fracpart = fracpart + QString((4 - fracpart.size() % 4) % 4, '0');
+
+  QString all = intpart + fracpart;
+  QVector<qint16> digits;
+  for (int i = 0; i < all.size(); i += 4)
+    digits.append(all.mid(i, 4).toShort());
+
+  qint16 weight = intpart.size() / 4 - 1;
+  while (! digits.isEmpty() && digits.first() == 0)
+  {
+    digits.removeFirst();
+    weight--;
+  }
+  while (! digits.isEmpty() && digits.last() == 0)
+    digits.removeLast();
+  if (digits.isEmpty())
+  {
+    weight = 0;
+    sign   = 0x0000;
+  }
+
+  putInt32(buffer, 8 + 2 * digits.size());
+  putInt16(buffer, digits.size());
+  putInt16(buffer, weight);
+  putInt16(buffer, sign);
+  putInt16(buffer, dscale);
+  for (int i = 0; i < digits.size(); i++)
+    putInt16(buffer, digits.at(i));
+
+  return true;
+}
+
+static bool putValue(QByteArray &buffer, CSVBinaryCopyWriter::Kind kind, const QVariant &value)
+{
+  if (value.isNull())
+  {
+    putInt32(buffer, -1);
+    return true;
+  }
+
+  QString text = value.toString().trimmed();
+  bool ok = true;
+  switch (kind)
+  {
+    case CSVBinaryCopyWriter::Bool:
+    {
+      QString lower = text.toLower();
+      if (lower == "t" || lower == "true" || lower == "y" || lower == "yes" ||
+          lower == "on" || lower == "1")
+        buffer.append(QByteArray::fromRawData("\0\0\0\1\1", 5));
+      else if (lower == "f" || lower == "false" || lower == "n" ||
+               lower == "no" || lower == "off" || lower == "0")
+        buffer.append(QByteArray::fromRawData("\0\0\0\1\0", 5));
+      else
+        ok = false;
+      break;
+    }
+    case CSVBinaryCopyWriter::Int2:
+    {
+      qint16 i = text.toShort(&ok);
+      putInt32(buffer, 2);
+      putInt16(buffer, i);
+      break;
+    }
+    case CSVBinaryCopyWriter::Int4:
+    {
+      qint32 i = text.toInt(&ok);
+      putInt32(buffer, 4);
+      putInt32(buffer, i);
+      break;
+    }
+    case CSVBinaryCopyWriter::Int8:
+    {
+      qint64 i = text.toLongLong(&ok);
+      putInt32(buffer, 8);
+      putInt64(buffer, i);
+      break;
+    }
+    case CSVBinaryCopyWriter::Float4:
+    {
+      float   f = text.toFloat(&ok);
+      quint32 bits;
+      memcpy(&bits, &f, 4);
+      putInt32(buffer, 4);
+      putInt32(buffer, bits);
+      break;
+    }
+    case CSVBinaryCopyWriter::Float8:
+    {
+      double  d = text.toDouble(&ok);
+      quint64 bits;
+      memcpy(&bits, &d, 8);
+      putInt32(buffer, 8);
+      putInt64(buffer, bits);
+      break;
+    }
+    case CSVBinaryCopyWriter::Numeric:
+      ok = putNumeric(buffer, text);
+      break;
+    case CSVBinaryCopyWriter::Date:
+    {
+      // other forms depend on the session's DateStyle; the server parses them
+      QDate date = QDate::fromString(text, Qt::ISODate);
+      ok = text.size() == 10 && date.isValid();
+      putInt32(buffer, 4);
+      putInt32(buffer, pgEpochDate.daysTo(date));
+      break;
+    }
+    case CSVBinaryCopyWriter::Timestamp:
+    {
+      /* Only plain ISO date and time, to the millisecond QTime keeps, and no
+         zone: a timestamp without time zone stores the wall clock time as
+         given, so it is encoded as such rather than converted through the
+         local zone. Anything else is left to the server.
+       */
+      static const QRegularExpression iso("^(\\d{4}-\\d{2}-\\d{2})[T ]"
+                                          "(\\d{2}:\\d{2}(?::\\d{2}(?:\\.\\d{1,3})?)?)$");
+      QRegularExpressionMatch match = iso.match(text);
+      QDate date = QDate::fromString(match.captured(1), Qt::ISODate);
+      QTime time = QTime::fromString(match.captured(2), Qt::ISODate);
+      ok = match.hasMatch() && date.isValid() && time.isValid();
+      putInt32(buffer, 8);
+      putInt64(buffer, pgEpoch.msecsTo(QDateTime(date, time, Qt::UTC)) * 1000);
+      break;
+    }
+    case CSVBinaryCopyWriter::Bytea:
+    {
+      QByteArray bytes = value.toByteArray();
+      if (value.type() != QVariant::ByteArray && bytes.startsWith("\\x"))
+        bytes = QByteArray::fromHex(bytes.mid(2));
+      putInt32(buffer, bytes.size());
+      buffer.append(bytes);
+      break;
+    }
+    default:
+    {
+      QByteArray bytes = value.toString().toUtf8();
+      putInt32(buffer, bytes.size());
+      buffer.append(bytes);
+    }
+  }
+
+  return ok;
+}
+
+CSVBinaryCopyWriter::CSVBinaryCopyWriter(CSVImportPlan *plan, int batchSize)
+  : CSVCopyWriter(plan, batchSize)
+{
+  for (int c = 0; c < plan->columnCount(); c++)
+    _kinds.append(nameToKind(plan->columnType(c)));
+}
+
+CSVBinaryCopyWriter::~CSVBinaryCopyWriter()
+{
+}
+
+// map a type as named by format_type() to its binary encoding
+CSVBinaryCopyWriter::Kind CSVBinaryCopyWriter::nameToKind(const QString &type)
+{
+  if ("boolean" == type)
+    return Bool;
+  else if ("smallint" == type)
+    return Int2;
+  else if ("integer" == type)
+    return Int4;
+  else if ("bigint" == type)
+    return Int8;
+  else if ("real" == type)
+    return Float4;
+  else if ("double precision" == type)
+    return Float8;
+  else if ("numeric" == type)
+    return Numeric;
+  else if ("date" == type)
+    return Date;
+  else if ("timestamp without time zone" == type)
+    return Timestamp;
+  else if ("text" == type || "character varying" == type || "character" == type)
+    return Text;
+  else if ("bytea" == type)
+    return Bytea;
+  return Unsupported;
+}
+
+void CSVBinaryCopyWriter::encodeChunk(CSVBinaryChunk &chunk)
+{
+  for (int r = chunk.begin; r < chunk.end; r++)
+  {
+    const CSVImportRow &row = chunk.rows->at(r);
+    putInt16(chunk.data, chunk.columns->size());
+    for (int i = 0; i < chunk.columns->size(); i++)
+    {
+      int c = chunk.columns->at(i);
+      if (! putValue(chunk.data, chunk.kinds->at(c), row.values.at(c)))
+      {
+        chunk.error = QString("Record %1: cannot convert '%2' for binary COPY")
+                        .arg(row.row + 1).arg(row.values.at(c).toString());
+        return;
+      }
+    }
+  }
+}
+
+/* If a value cannot be converted here, e.g. a date in another style, the
+   batch is sent with text COPY instead and the server parses it.
+ */
+bool CSVBinaryCopyWriter::writeBatch(const QList<CSVImportRow> &rows, QString *errmsg)
+{
+  if (! _conn)
+    return CSVCopyWriter::writeBatch(rows, errmsg);
+
+  const QBitArray &omitted = rows.first().omitted;
+  QVector<int> columns;
+  for (int c = 0; c < _plan->columnCount(); c++)
+  {
+    if (omitted.testBit(c))
+      continue;
+    if (_kinds.at(c) == Unsupported)
+      return CSVCopyWriter::writeBatch(rows, errmsg);
+    columns.append(c);
+  }
+
+  int threads = qMax(QThread::idealThreadCount(), 1);
+  int perChunk = qMax(int(MinChunkRows), (rows.size() + threads - 1) / threads);
+  QList<CSVBinaryChunk> chunks;
+  for (int begin = 0; begin < rows.size(); begin += perChunk)
+  {
+    CSVBinaryChunk chunk;
+    chunk.rows    = &rows;
+    chunk.columns = &columns;
+    chunk.kinds   = &_kinds;
+    chunk.begin   = begin;
+    chunk.end     = qMin(begin + perChunk, rows.size());
+    chunks.append(chunk);
+  }
+  QtConcurrent::blockingMap(chunks, encodeChunk);
+
+  for (int i = 0; i < chunks.size(); i++)
+  {
+    if (! chunks.at(i).error.isEmpty())
+    {
+      if (DEBUG)
+        qDebug("CSVBinaryCopyWriter::writeBatch() sending as text: %s",
+               qPrintable(chunks.at(i).error));
+      return CSVCopyWriter::writeBatch(rows, errmsg);
+    }
+  }
+
+  if (! beginCopy(_plan->table(), columnNames(omitted), "FORMAT binary", errmsg))
+    return false;
+
+  // signature, flags and header extension length
+  QByteArray header("PGCOPY\n\377\r\n\0", 11);
+  putInt32(header, 0);
+  putInt32(header, 0);
+  bool sent = putData(header, errmsg);
+  for (int i = 0; sent && i < chunks.size(); i++)
+    sent = putData(chunks[i].data, errmsg);
+
+  QByteArray trailer;
+  putInt16(trailer, -1);
+  if (! sent || ! putData(trailer, errmsg))
+  {
+    endCopy("could not send data", 0);
+    return false;
+  }
+
+  if (! endCopy(0, errmsg))
+    return false;
+
+  if (DEBUG)
+    qDebug("CSVBinaryCopyWriter::writeBatch() %d rows in %d chunks",
+           rows.size(), chunks.size());
+
+  _written += rows.size();
+  return true;
+}
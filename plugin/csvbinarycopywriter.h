@@ -0,0 +1,46 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVBINARYCOPYWRITER_H__
+#define __CSVBINARYCOPYWRITER_H__
+
+#include <QVector>
+
+#include "csvcopywriter.h"
+
+class CSVBinaryChunk;
+
+/* Writes Insert batches with COPY in binary format. Values are converted
+   to the binary form of each target column's type on worker threads, so
+   the server does not have to parse them. Batches with a column of a type
+   the encoder does not know, or a value it cannot convert, are sent in text
+   format instead.
+ */
+class CSVBinaryCopyWriter : public CSVCopyWriter
+{
+  public:
+    enum Kind { Unsupported, Bool, Int2, Int4, Int8, Float4, Float8,
+                Numeric, Date, Timestamp, Text, Bytea };
+
+    static const int MinChunkRows = 500;
+
+    CSVBinaryCopyWriter(CSVImportPlan *plan, int batchSize = 0);
+    virtual ~CSVBinaryCopyWriter();
+
+    static Kind nameToKind(const QString &type);
+
+  protected:
+    virtual bool writeBatch(const QList<CSVImportRow> &rows, QString *errmsg);
+    static void  encodeChunk(CSVBinaryChunk &chunk);
+
+    QVector<Kind> _kinds;
+};
+
+#endif
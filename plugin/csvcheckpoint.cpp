@@ -0,0 +1,121 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvcheckpoint.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QSettings>
+#include <QStandardPaths>
+
+#define DEBUG false
+
+// bytes at the start of the file that go into the fingerprint
+static const int FingerprintBytes = 65536;
+
+/* Data read from a stream has nothing to come back to, so only regular
+   files get a journal.
+ */
+CSVCheckpoint::CSVCheckpoint(const QString &filename, const QString &map,
+                             const QString &settings, const QSqlDatabase &db)
+  : _settings(settings),
+    _lastCommitted(-1)
+{
+  QFileInfo info(filename);
+  if (filename.isEmpty() || filename == "-" || ! info.isFile())
+    return;
+
+  _filename    = info.absoluteFilePath();
+  _fingerprint = fingerprint();
+
+  QString key = QString("%1|%2|%3|%4|%5")
+                  .arg(_filename, map, db.hostName())
+                  .arg(db.port()).arg(db.databaseName());
+  QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+              + "/checkpoints";
+  if (! QDir().mkpath(dir))
+    return;
+
+  _journal = dir + "/" +
+             QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex() +
+             ".ini";
+}
+
+/* read the journal; false if there is none for the file and settings as
+   they are now. errorString() says why an existing journal does not apply.
+ */
+bool CSVCheckpoint::load()
+{
+  _lastCommitted = -1;
+  _errorString   = QString {};
+  if (! isValid() || ! QFile::exists(_journal))
+    return false;
+
+  QSettings journal(_journal, QSettings::IniFormat);
+  if (journal.value("fingerprint").toString() != _fingerprint)
+    _errorString = QObject::tr("%1 changed since the checkpoint was saved")
+                     .arg(_filename);
+  else if (journal.value("settings").toString() != _settings)
+    _errorString = QObject::tr("the parse settings or the map changed since "
+                               "the checkpoint was saved");
+
+  if (! _errorString.isEmpty())
+  {
+    if (DEBUG)
+      qDebug("CSVCheckpoint::load() %s", qPrintable(_errorString));
+    return false;
+  }
+
+  _lastCommitted = journal.value("lastCommittedRow", -1).toInt();
+  return _lastCommitted >= 0;
+}
+
+void CSVCheckpoint::remove()
+{
+  if (isValid())
+    QFile::remove(_journal);
+  _lastCommitted = -1;
+}
+
+// record that every record up to and including row is committed
+bool CSVCheckpoint::save(int row)
+{
+  if (! isValid())
+    return false;
+
+  QSettings journal(_journal, QSettings::IniFormat);
+  journal.setValue("file",             _filename);
+  journal.setValue("fingerprint",      _fingerprint);
+  journal.setValue("settings",         _settings);
+  journal.setValue("lastCommittedRow", row);
+  journal.setValue("saved",            QDateTime::currentDateTime());
+  journal.sync();
+
+  _lastCommitted = row;
+  return journal.status() == QSettings::NoError;
+}
+
+QString CSVCheckpoint::fingerprint() const
+{
+  QFileInfo info(_filename);
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  QFile file(_filename);
+  if (file.open(QIODevice::ReadOnly))
+    hash.addData(file.read(FingerprintBytes));
+
+  return QString("%1:%2:%3")
+           .arg(info.size())
+           .arg(info.lastModified().toMSecsSinceEpoch())
+           .arg(QString::fromLatin1(hash.result().toHex()));
+}
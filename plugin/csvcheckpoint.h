@@ -0,0 +1,53 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVCHECKPOINT_H__
+#define __CSVCHECKPOINT_H__
+
+#include <QSqlDatabase>
+#include <QString>
+
+/* A small journal recording how far the import of a data file with a map
+   into a database has been committed, so an import that stopped can pick
+   up after the last committed record. The journal lives in the user's
+   application data directory and is keyed by the file, map and database;
+   a fingerprint of the file's size, modification time and first bytes
+   makes sure a changed file does not resume. The settings string holds
+   whatever decides how records are numbered and written (parse policy,
+   header row, delimiter, map contents); a journal saved with different
+   settings does not resume either.
+ */
+class CSVCheckpoint
+{
+  public:
+    CSVCheckpoint(const QString &filename, const QString &map,
+                  const QString &settings,
+                  const QSqlDatabase &db = QSqlDatabase::database());
+
+    QString errorString()      const { return _errorString; }
+    bool    isValid()          const { return ! _journal.isEmpty(); }
+    int     lastCommittedRow() const { return _lastCommitted; }
+
+    bool load();
+    void remove();
+    bool save(int row);
+
+  protected:
+    QString fingerprint() const;
+
+    QString _errorString;
+    QString _filename;
+    QString _fingerprint;
+    QString _journal;
+    QString _settings;
+    int     _lastCommitted;
+};
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvcopywriter.h"
+
+#include <QSqlDriver>
+#include <QStringList>
+
+#include <libpq-fe.h>
+
+#define DEBUG false
+
+CSVCopyWriter::CSVCopyWriter(CSVImportPlan *plan, int batchSize)
+  : CSVImportWriter(plan, batchSize > 0 ? batchSize : int(DefaultBatchSize)),
+    _conn(connection(plan->database()))
+{
+}
+
+CSVCopyWriter::~CSVCopyWriter()
+{
+}
+
+// the libpq connection under a QPSQL database, or 0 for any other driver
+PGconn *CSVCopyWriter::connection(const QSqlDatabase &db)
+{
+  if (! db.isOpen() || ! db.driver())
+    return 0;
+
+  QVariant handle = db.driver()->handle();
+  if (handle.isValid() && qstrcmp(handle.typeName(), "PGconn*") == 0)
+    return *static_cast<PGconn **>(handle.data());
+
+  return 0;
+}
+
+// a failing statement fails the whole batch, so a single row needs the
+// batch's savepoint
+bool CSVCopyWriter::rowSavepoints() const
+{
+  return false;
+}
+
+bool CSVCopyWriter::writeBatch(const QList<CSVImportRow> &rows, QString *errmsg)
+{
+  if (! _conn)
+  {
+    if (errmsg)
+      *errmsg = QString("COPY needs a PostgreSQL connection");
+    return false;
+  }
+
+  if (! copyText(_plan->table(), rows, false, errmsg))
+    return false;
+
+  _written += rows.size();
+  return true;
+}
+
+void CSVCopyWriter::reconnected()
+{
+  CSVImportWriter::reconnected();
+  _conn = connection(_plan->database());
+}
+
+bool CSVCopyWriter::beginCopy(const QString &table, const QStringList &names,
+                              const QString &options, QString *errmsg)
+{
+  QString sql = QString("COPY %1 (%2) FROM STDIN%3;")
+                  .arg(table, names.join(", "),
+                       options.isEmpty() ? QString {} : " WITH (" + options + ")");
+  PGresult *res = PQexec(_conn, sql.toUtf8().constData());
+  bool started  = PQresultStatus(res) == PGRES_COPY_IN;
+  if (! started && errmsg)
+    *errmsg = QString::fromUtf8(PQresultErrorMessage(res));
+  PQclear(res);
+
+  return started;
+}
+
+// the columns a batch does not leave to their defaults
+QStringList CSVCopyWriter::columnNames(const QBitArray &omitted) const
+{
+  QStringList names;
+  for (int c = 0; c < _plan->columnCount(); c++)
+    if (! omitted.testBit(c))
+      names.append(_plan->columnName(c));
+  return names;
+}
+
+/* Copy rows into table in text format. With rowNumbers the first column,
+   csvimp_row, gets each row's 0-based position in the data file.
+ */
+bool CSVCopyWriter::copyText(const QString &table, const QList<CSVImportRow> &rows,
+                             bool rowNumbers, QString *errmsg)
+{
+  const QBitArray &omitted = rows.first().omitted;
+  QStringList names = columnNames(omitted);
+  if (rowNumbers)
+    names.prepend("csvimp_row");
+  if (! beginCopy(table, names, QString {}, errmsg))
+    return false;
+
+  QByteArray buffer;
+  buffer.reserve(BufferSize + 4096);
+  for (int r = 0; r < rows.size(); r++)
+  {
+    bool first = true;
+    if (rowNumbers)
+    {
+      buffer.append(QByteArray::number(rows.at(r).row));
+      first = false;
+    }
+    for (int c = 0; c < _plan->columnCount(); c++)
+    {
+      if (omitted.testBit(c))
+        continue;
+      if (! first)
+        buffer.append('\t');
+      encodeValue(rows.at(r).values.at(c), buffer);
+      first = false;
+    }
+    buffer.append('\n');
+
+    if (buffer.size() >= BufferSize && ! putData(buffer, errmsg))
+    {
+      endCopy("could not send data", 0);
+      return false;
+    }
+  }
+
+  if (! putData(buffer, errmsg))
+  {
+    endCopy("could not send data", 0);
+    return false;
+  }
+
+  return endCopy(0, errmsg);
+}
+
+/* Text format: \N is null, and backslash, tab, newline and carriage return
+   are backslash escaped. Byte arrays go to bytea columns in hex form.
+ */
+void CSVCopyWriter::encodeValue(const QVariant &value, QByteArray &buffer)
+{
+  if (value.isNull())
+  {
+    buffer.append("\\N");
+    return;
+  }
+
+  if (value.type() == QVariant::ByteArray)
+  {
+    buffer.append("\\\\x");
+    buffer.append(value.toByteArray().toHex());
+    return;
+  }
+
+  QByteArray text = value.toString().toUtf8();
+  for (const char *p = text.constData(), *end = p + text.size(); p < end; p++)
+  {
+    switch (*p)
+    {
+      case '\\': buffer.append("\\\\"); break;
+      case '\t': buffer.append("\\t");  break;
+      case '\n': buffer.append("\\n");  break;
+      case '\r': buffer.append("\\r");  break;
+      default:   buffer.append(*p);
+    }
+  }
+}
+
+bool CSVCopyWriter::endCopy(const char *failure, QString *errmsg)
+{
+  if (PQputCopyEnd(_conn, failure) != 1 && errmsg)
+    *errmsg = QString::fromUtf8(PQerrorMessage(_conn));
+
+  bool result = ! failure;
+  PGresult *res;
+  while ((res = PQgetResult(_conn)))
+  {
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    {
+      if (result && errmsg)
+        *errmsg = QString::fromUtf8(PQresultErrorMessage(res));
+      result = false;
+    }
+    PQclear(res);
+  }
+
+  if (DEBUG)
+    qDebug("CSVCopyWriter::endCopy() %s", result ? "succeeded" : "failed");
+
+  return result;
+}
+
+bool CSVCopyWriter::putData(QByteArray &buffer, QString *errmsg)
+{
+  if (buffer.isEmpty())
+    return true;
+
+  if (PQputCopyData(_conn, buffer.constData(), buffer.size()) != 1)
+  {
+    if (errmsg)
+      *errmsg = QString::fromUtf8(PQerrorMessage(_conn));
+    return false;
+  }
+
+  buffer.resize(0);
+  return true;
+}
@@ -0,0 +1,54 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVCOPYWRITER_H__
+#define __CSVCOPYWRITER_H__
+
+#include <QByteArray>
+#include <QSqlDatabase>
+
+#include "csvimportwriter.h"
+
+typedef struct pg_conn PGconn;
+
+/* Writes Insert batches with COPY ... FROM STDIN in text format, talking to
+   libpq directly through the QPSQL driver's connection handle.
+   Encoding and sending happen on the thread that calls add() and flush():
+   the import thread, unless the writer belongs to a CSVParallelWriter
+   worker with its own connection.
+ */
+class CSVCopyWriter : public CSVImportWriter
+{
+  public:
+    static const int DefaultBatchSize = 10000;
+    static const int BufferSize       = 65536;
+
+    CSVCopyWriter(CSVImportPlan *plan, int batchSize = 0);
+    virtual ~CSVCopyWriter();
+
+    static PGconn *connection(const QSqlDatabase &db);
+
+  protected:
+    virtual bool writeBatch(const QList<CSVImportRow> &rows, QString *errmsg);
+    virtual bool rowSavepoints() const;
+    virtual void reconnected();
+    virtual void encodeValue(const QVariant &value, QByteArray &buffer);
+    bool         beginCopy(const QString &table, const QStringList &names,
+                           const QString &options, QString *errmsg);
+    QStringList  columnNames(const QBitArray &omitted) const;
+    bool         copyText(const QString &table, const QList<CSVImportRow> &rows,
+                          bool rowNumbers, QString *errmsg);
+    bool         endCopy(const char *failure, QString *errmsg);
+    bool         putData(QByteArray &buffer, QString *errmsg);
+
+    PGconn *_conn;
+};
+
+#endif
@@ -10,19 +10,145 @@
 
 #include "csvdata.h"
 
+#include <QCoreApplication>
 #include <QDebug>
 #include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QProgressDialog>
+#include <QTemporaryFile>
+#include <QThread>
+#include <QtConcurrentMap>
 
 #include "interactivemessagehandler.h"
+#include "xlsxreader.h"
 
 #define INPUTBUFSIZE 1024
 
+// a newline-aligned slice of a JSON Lines file, parsed on a worker thread
+class JsonLinesChunk
+{
+  public:
+    const char  *data;
+    qint64       length;
+    qint64       offset;
+    QStringList  columns;
+
+    QList<QStringList> rows;     // invalid lines hold just the raw text
+    QVector<qint64>    offsets;
+    QVector<bool>      valid;
+};
+
+// columns are either plain top-level keys or RFC 6901 JSON pointers
+static QJsonValue jsonLookup(const QJsonObject &obj, const QString &column)
+{
+  if (! column.startsWith('/'))
+    return obj.value(column);
+
+  QJsonValue  value(obj);
+  QStringList tokens = column.mid(1).split('/');
+  for (int i = 0; i < tokens.size(); i++)
+  {
+    QString token = tokens.at(i);
+    token.replace("~1", "/").replace("~0", "~");
+    if (value.isObject())
+      value = value.toObject().value(token);
+    else if (value.isArray())
+    {
+      bool ok  = false;
+      int  idx = token.toInt(&ok);
+      value = ok ? value.toArray().at(idx) : QJsonValue(QJsonValue::Undefined);
+    }
+    else
+      return QJsonValue(QJsonValue::Undefined);
+  }
+
+  return value;
+}
+
+static QString jsonToString(const QJsonValue &value)
+{
+  switch (value.type())
+  {
+    case QJsonValue::Null:
+    case QJsonValue::Undefined:
+      return QString {};
+    case QJsonValue::Bool:
+      return value.toBool() ? "true" : "false";
+    case QJsonValue::String:
+      return value.toString();
+    case QJsonValue::Array:
+      return QJsonDocument(value.toArray()).toJson(QJsonDocument::Compact);
+    case QJsonValue::Object:
+      return QJsonDocument(value.toObject()).toJson(QJsonDocument::Compact);
+    default:
+      return value.toVariant().toString();
+  }
+}
+
+static JsonLinesChunk parseJsonLinesChunk(const JsonLinesChunk &in)
+{
+  JsonLinesChunk chunk = in;
+  const char *p   = chunk.data;
+  const char *end = chunk.data + chunk.length;
+
+  while (p < end)
+  {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (! eol)
+      eol = end;
+
+    QByteArray line = QByteArray::fromRawData(p, eol - p).trimmed();
+    if (! line.isEmpty())
+    {
+      QJsonParseError error;
+      QJsonDocument   doc = QJsonDocument::fromJson(line, &error);
+      bool            ok  = (error.error == QJsonParseError::NoError && doc.isObject());
+      QStringList     record;
+
+      if (ok)
+      {
+        QJsonObject obj = doc.object();
+        for (int c = 0; c < chunk.columns.size(); c++)
+          record.append(jsonToString(jsonLookup(obj, chunk.columns.at(c))));
+      }
+      else
+        record.append(QString::fromUtf8(line));
+
+      chunk.rows.append(record);
+      chunk.offsets.append(chunk.offset + (p - chunk.data));
+      chunk.valid.append(ok);
+    }
+    p = eol + 1;
+  }
+
+  return chunk;
+}
+
+/* A stream that stops delivering looks the same whether it ended or failed.
+   Files (stdin, pipes) keep an error code; other devices only change their
+   error string, so compare it with what the device said before reading.
+   A socket sets one when the peer closes, which is the normal end.
+ */
+static bool readFailed(QIODevice *device, const QString &noError)
+{
+  QFileDevice *file = qobject_cast<QFileDevice *>(device);
+  if (file)
+    return file->error() != QFileDevice::NoError;
+  if (device->inherits("QAbstractSocket"))
+    return ! device->atEnd();
+
+  return device->errorString() != noError;
+}
+
 class CSVDataPrivate
 {
   public:
     CSVDataPrivate(CSVData *parent)
-      : _parent(parent)
+      : _loaded(false),
+        _parent(parent)
     {
     }
 
@@ -33,6 +159,11 @@ class CSVDataPrivate
     int     row;
     int     col;
     int     maxcols;
+    int     expected;
+    qint64  offset;
+    qint64  recordStart;
+    bool    aborted;
+    bool    headerRow;
     QStringList record;
 
     bool parseInit()
@@ -44,17 +175,74 @@ class CSVDataPrivate
       row = 0;
       col = 0;
       maxcols = 0;
+      expected = _parent->fixedWidthLayout().size();
+      offset = 0;
+      recordStart = 0;
+      aborted = false;
+      headerRow = true;
       record = QStringList();
 
       _model.clear();
       _header.clear();
+      _issues.clear();
+      _quarantine.clear();
+      _loaded = true;
 
       return true;
     }
 
+    // returns false if the record should not go into the model
+    bool addIssue(CSVParseIssue::Kind kind)
+    {
+      CSVParseIssue issue;
+      issue.offset   = recordStart;
+      issue.row      = row;
+      issue.expected = expected;
+      issue.actual   = col;
+      issue.kind     = kind;
+      _issues.append(issue);
+
+      switch (_parent->parsePolicy())
+      {
+        case CSVData::SkipBadRows:
+          return false;
+        case CSVData::QuarantineBadRows:
+          _quarantine.append(record);
+          return false;
+        case CSVData::AbortOnBadRow:
+          aborted = true;
+          return false;
+        default:
+          return true;
+      }
+    }
+
+    void finishRecord(bool unterminated = false)
+    {
+      bool keep = true;
+      if (row == 0 && _parent->fixedWidthLayout().isEmpty())
+        expected = col;
+
+      if (unterminated)
+        keep = addIssue(CSVParseIssue::UnterminatedQuote);
+      else if (col != expected)
+        keep = addIssue(col < expected ? CSVParseIssue::TooFewColumns
+                                       : CSVParseIssue::TooManyColumns);
+
+      if (keep)
+      {
+        _model.append(record);
+        if (col > maxcols)
+          maxcols = col;
+      }
+      record = QStringList();
+      row++;
+      col = 0;
+    }
+
     bool parse(QByteArray &line)
     {
-      for (int i = 0; i < line.length(); i++)
+      for (int i = 0; i < line.length() && ! aborted; i++)
       {
         char c = line.at(i);
         if (inQuote) // handle everything differently inside double-quotes
@@ -94,12 +282,8 @@ class CSVDataPrivate
 
             if ('\r' == c || '\n' == c)
             {
-              _model.append(record);
-              record = QStringList();
-              row++;
-              if (col > maxcols)
-                maxcols = col;
-              col = 0;
+              finishRecord();
+              recordStart = offset + i + 1;
             }
           }
           else if(('"' == c) && (_parent->delimiter() != '\t'))
@@ -124,19 +308,85 @@ class CSVDataPrivate
           }
         }
       }
+      offset += line.length();
 
-      return true;
+      return ! aborted;
+    }
+
+    // fixed-width records are sliced by position, there is nothing to tokenize
+    bool parseFixed(const QByteArray &line)
+    {
+      QList<QPair<int, int> > layout = _parent->fixedWidthLayout();
+
+      int end = line.length();
+      while (end > 0 && ('\n' == line.at(end - 1) || '\r' == line.at(end - 1)))
+        end--;
+
+      if (end > 0)
+      {
+        for (int i = 0; i < layout.size(); i++)
+        {
+          int start = layout.at(i).first - 1;
+          if (start < end)
+          {
+            QByteArray value = line.mid(start, qMin(layout.at(i).second,
+                                                    end - start)).trimmed();
+            if (value.isEmpty())
+              record.append(QString {});
+            else
+              record.append(value);
+            col++;
+          }
+          else
+            record.append(QString {});
+        }
+        finishRecord();
+      }
+      offset     += line.length();
+      recordStart = offset;
+
+      return ! aborted;
+    }
+
+    // records that arrive already split into fields, e.g. spreadsheet rows
+    bool parseRecord(const QStringList &fields)
+    {
+      record = fields;
+      col    = fields.size();
+      finishRecord();
+      return ! aborted;
+    }
+
+    bool parseInvalid(const QStringList &raw)
+    {
+      record = raw;
+      col    = 0;
+      addIssue(CSVParseIssue::InvalidRecord);
+      record = QStringList();
+      row++;
+      return ! aborted;
     }
 
     bool parseCleanup()
     {
-      if (haveText)
+      if ((haveText || inQuote || ! record.isEmpty()) && ! aborted)
       {
-        record.append(field->trimmed());
-        _model.append(record);
+        if (haveText)
+          record.append(field->trimmed());
+        else
+          record.append(QString {});
+        col++;
+        finishRecord(inQuote);
       }
 
-      if (_parent->firstRowHeaders() && ! _model.isEmpty())
+      if (aborted)
+      {
+        // the rows before the bad one must not be imported on their own
+        _model.clear();
+        _header.clear();
+        maxcols = 0;
+      }
+      else if (headerRow && _parent->firstRowHeaders() && ! _model.isEmpty())
       {
         _header = _model.at(0);
         _model.takeFirst();
@@ -144,20 +394,24 @@ class CSVDataPrivate
 
       delete field;
 
-      return true;
+      return ! aborted;
     }
 
     QStringList         _line;
     QString             _filename;
     QStringList         _header;
     QList<QStringList>  _model;
+    QVector<CSVParseIssue> _issues;
+    QList<QStringList>  _quarantine;
+    bool                _loaded;
     CSVData            *_parent;
 };
 
 CSVData::CSVData(QObject *parent, const char *name, const QChar delim)
   : QObject(parent),
     _data(0),
-    _firstRowHeaders(false)
+    _firstRowHeaders(false),
+    _parsePolicy(KeepBadRows)
 {
   _data = new CSVDataPrivate(this);
   setObjectName(name ? name : "_CSVData");
@@ -173,6 +427,20 @@ CSVData::~CSVData() {
   }
 }
 
+// parse the current file again after a change to the parse settings
+void CSVData::reload()
+{
+  if (! _data || ! _data->_loaded)
+    return;
+
+  if (_data->_filename.isEmpty())
+    _msghandler->message(QtWarningMsg, tr("Cannot Reload"),
+                         tr("<p>The data were read from a stream and cannot "
+                            "be read again with the new settings."));
+  else
+    load(_data->_filename, qobject_cast<QWidget*>(parent()));
+}
+
 unsigned int CSVData::columns()
 {
   unsigned int n = 0;
@@ -193,8 +461,7 @@ void CSVData::setDelimiter(const QChar delim)
   if (newdelim != _delimiter)
   {
     _delimiter = newdelim;
-    if (_data && ! _data->_filename.isEmpty())
-      load(_data->_filename, qobject_cast<QWidget*>(parent()));
+    reload();
   }
 }
 
@@ -203,12 +470,40 @@ bool CSVData::firstRowHeaders() const
   return _firstRowHeaders;
 }
 
+QStringList CSVData::jsonColumns() const
+{
+  return _jsonColumns;
+}
+
+void CSVData::setJsonColumns(const QStringList &columns)
+{
+  if (columns != _jsonColumns)
+  {
+    _jsonColumns = columns;
+    reload();
+  }
+}
+
+QList<QPair<int, int> > CSVData::fixedWidthLayout() const
+{
+  return _fixedWidth;
+}
+
+void CSVData::setFixedWidthLayout(const QList<QPair<int, int> > &layout)
+{
+  if (layout != _fixedWidth)
+  {
+    _fixedWidth = layout;
+    reload();
+  }
+}
+
 void CSVData::setFirstRowHeaders(bool y)
 {
   if (_firstRowHeaders != y)
   {
     _firstRowHeaders = y;
-    if (_data)
+    if (_data && _data->headerRow)
     {
       if (y && ! _data->_model.isEmpty())
       {
@@ -228,7 +523,8 @@ QString CSVData::header(int column)
 {
     QString label;
 
-    if (_firstRowHeaders && _data && _data->_header.size() > column) {
+    if (_data && (_firstRowHeaders || ! _data->headerRow) &&
+        _data->_header.size() > column) {
         label = _data->_header.at(column);
         if (label.isEmpty()) {
             label = tr("unnamed");
@@ -244,12 +540,23 @@ QString CSVData::header(int column)
     return label;
 }
 
+/* Load from a file name. The name - reads standard input, and named pipes
+   are read as streams like any other sequential device.
+ */
 bool CSVData::load(QString filename, QWidget *parent)
 {
-  _data->_filename = filename;
-  QFile file(filename);
+  QFile file;
+  bool  opened;
 
-  if(!file.open(QIODevice::ReadOnly))
+  if (filename == "-")
+    opened = file.open(stdin, QIODevice::ReadOnly);
+  else
+  {
+    file.setFileName(filename);
+    opened = file.open(QIODevice::ReadOnly);
+  }
+
+  if (! opened)
   {
     _msghandler->message(QtWarningMsg, tr("Open Failed"),
                          tr("<p>Could not open %1 for reading: %2")
@@ -257,15 +564,36 @@ bool CSVData::load(QString filename, QWidget *parent)
     return false;
   }
 
-  QString          progresstext(tr("Loading %1: line %2"));
+  bool result = load(&file, filename, parent);
+  file.close();
+
+  // a stream cannot be read a second time when the settings change
+  _data->_filename = file.isSequential() ? QString {} : filename;
+
+  return result;
+}
+
+/* Load from an open device. The name is used in messages and its suffix
+   picks the format. Sequential devices (stdin, pipes, sockets, processes)
+   are read front to back without seeking; progress then shows a byte count
+   because the total size is not known.
+ */
+bool CSVData::load(QIODevice *device, const QString &name, QWidget *parent)
+{
+  _data->_filename = QString {};
+
+  bool             sequential = device->isSequential();
+  QString          progresstext(sequential ? tr("Loading %1: line %2, %3 bytes")
+                                           : tr("Loading %1: line %2"));
   QProgressDialog *progress = 0;
   qint64           bytes    = 0;
-  int              expected = file.size();
+  int              expected = sequential ? 0 : device->size();
   bool             result   = true;
+  QString          noError  = device->errorString();
 
   if (parent)
   {
-    progress = new QProgressDialog(progresstext.arg(filename).arg(0),
+    progress = new QProgressDialog(progresstext.arg(name).arg(0).arg(0),
                                    tr("Stop"), bytes, expected, parent);
     progress->setWindowModality(Qt::WindowModal);
     progress->setValue(0);
@@ -274,32 +602,81 @@ bool CSVData::load(QString filename, QWidget *parent)
   _data->parseInit();
   char   buf[INPUTBUFSIZE];
 
-  for (qint64 lines = 0; ! file.atEnd(); lines++)
+  QString suffix = QFileInfo(name).suffix().toLower();
+  bool    isXlsx = (suffix == "xlsx");
+  bool    isJson = (suffix == "jsonl" || suffix == "ndjson");
+  if (isXlsx && sequential)
+  {
+    // the zip directory is at the end of the file, so spool the stream first
+    QTemporaryFile spool;
+    result = spool.open();
+    while (result)
+    {
+      QByteArray chunk = device->read(INPUTBUFSIZE * 64);
+      if (chunk.isEmpty() && ! device->waitForReadyRead(-1))
+        break;
+      result = spool.write(chunk) == chunk.size();
+    }
+    if (result && spool.seek(0))
+      result = loadXlsx(spool, name, progress);
+  }
+  else if (isXlsx)
+    result = loadXlsx(*device, name, progress);
+  else if (isJson)
+    result = loadJsonLines(*device, name, progress);
+
+  for (qint64 lines = 0; ! isXlsx && ! isJson && (sequential || ! device->atEnd()); lines++)
   {
-    qint64 lineLength = file.readLine(buf, sizeof(buf));
+    QByteArray ba;
+    qint64     lineLength;
+    if (_fixedWidth.isEmpty())
+    {
+      lineLength = device->readLine(buf, sizeof(buf));
+      if (lineLength > 0)
+        ba = QByteArray(buf);
+    }
+    else
+    {
+      ba = device->readLine(); // slicing by position needs the whole record
+      lineLength = ba.isEmpty() ? -1 : ba.length();
+    }
+
+    if (lineLength <= 0 && sequential)
+    {
+      // pipes block in readLine until the writer closes; sockets and
+      // processes have to be waited on
+      if (device->waitForReadyRead(-1))
+        continue;
+      if (readFailed(device, noError))
+        lineLength = -1;
+      else if (lineLength == 0 || device->atEnd())
+        break;
+    }
+
     if (lineLength == -1)
     {
       _msghandler->message(QtWarningMsg, tr("Read Error"),
                            tr("<p>Error Reading %1: %2")
-                             .arg(filename, file.errorString()));
+                             .arg(name, device->errorString()));
       if (progress)
         progress->cancel();
       result = false;
       break;
     }
 
-    QByteArray ba(buf);
-    if (! _data->parse(ba))
+    if (! (_fixedWidth.isEmpty() ? _data->parse(ba) : _data->parseFixed(ba)))
     {
       _msghandler->message(QtWarningMsg, tr("Parsing Error"),
-                           tr("<p>Error parsing the data from %1 (delimiter %2).")
-                             .arg(filename).arg(_delimiter));
+                           tr("<p>Error parsing the data from %1 (delimiter %2): %3")
+                             .arg(name).arg(_delimiter)
+                             .arg(describe(_data->_issues.last())));
       if (progress)
         progress->cancel();
       result = false;
       break;
     }
 
+    bytes += lineLength;
     if (progress)
     {
       if (progress->wasCanceled())
@@ -307,18 +684,23 @@ bool CSVData::load(QString filename, QWidget *parent)
         result = false;
         break;
       }
-      bytes += lineLength;
       if ((lines % 10000) == 0)
       {
-        progress->setValue(bytes);
-        progress->setLabelText(progresstext.arg(filename).arg(lines));
+        if (! sequential)
+          progress->setValue(bytes);
+        progress->setLabelText(progresstext.arg(name).arg(lines).arg(bytes));
       }
     }
   }
 
-  _data->parseCleanup();
-
-  file.close();
+  if (! _data->parseCleanup() && result)
+  {
+    _msghandler->message(QtWarningMsg, tr("Parsing Error"),
+                         tr("<p>Error parsing the data from %1 (delimiter %2): %3")
+                           .arg(name).arg(_delimiter)
+                           .arg(describe(_data->_issues.last())));
+    result = false;
+  }
 
   if (progress)
     progress->setValue(expected);
@@ -326,11 +708,234 @@ bool CSVData::load(QString filename, QWidget *parent)
   return result;
 }
 
+QVector<CSVParseIssue> CSVData::issues() const
+{
+  if (_data)
+    return _data->_issues;
+
+  return QVector<CSVParseIssue>();
+}
+
+/* JSON Lines files are memory mapped and cut into one newline-aligned chunk
+   per core. The chunks are parsed in parallel and then appended to the model
+   in file order, so row numbers and issue offsets match the file.
+   Without explicit columns the top-level keys of the first record, sorted
+   by name, define the columns. The column names are the header; every
+   line is a data record.
+ */
+bool CSVData::loadJsonLines(QIODevice &device, const QString &filename, QProgressDialog *progress)
+{
+  QFile      *file = qobject_cast<QFile *>(&device);
+  qint64      size = device.isSequential() ? 0 : device.size();
+  const char *data = 0;
+  QByteArray  contents;
+
+  if (file && size > 0)
+    data = reinterpret_cast<const char *>(file->map(0, size));
+  if (! data)
+  {
+    contents = device.readAll();
+    data     = contents.constData();
+    size     = contents.size();
+  }
+
+  QStringList columns = _jsonColumns;
+  for (qint64 pos = 0; columns.isEmpty() && pos < size; )
+  {
+    const char *eol = static_cast<const char *>(memchr(data + pos, '\n', size - pos));
+    qint64      len = eol ? eol - (data + pos) : size - pos;
+    QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromRawData(data + pos, len));
+    if (doc.isObject())
+      columns = doc.object().keys();
+    pos += len + 1;
+  }
+
+  QList<JsonLinesChunk> chunks;
+  int    threads = qMax(1, QThread::idealThreadCount());
+  qint64 start   = 0;
+  while (start < size)
+  {
+    qint64 end = qMin(size, start + size / threads + 1);
+    const char *eol = static_cast<const char *>(memchr(data + end - 1, '\n', size - end + 1));
+    end = eol ? eol - data + 1 : size;
+
+    JsonLinesChunk chunk;
+    chunk.data    = data + start;
+    chunk.length  = end - start;
+    chunk.offset  = start;
+    chunk.columns = columns;
+    chunks.append(chunk);
+    start = end;
+  }
+
+  if (progress)
+    progress->setLabelText(tr("Parsing %1").arg(filename));
+
+  // keep the Stop button live while the chunks are parsed
+  QFuture<JsonLinesChunk> future = QtConcurrent::mapped(chunks, parseJsonLinesChunk);
+  while (progress && ! future.isFinished())
+  {
+    QCoreApplication::processEvents(QEventLoop::AllEvents, 50);
+    if (progress->wasCanceled())
+      future.cancel();
+    QThread::msleep(10);
+  }
+  future.waitForFinished();
+
+  bool result = ! future.isCanceled();
+  QList<JsonLinesChunk> parsed;
+  if (result)
+    parsed = future.results();
+
+  _data->expected  = columns.size();
+  _data->headerRow = false;
+  _data->_header   = columns;
+  for (int c = 0; result && c < parsed.size(); c++)
+  {
+    const JsonLinesChunk &chunk = parsed.at(c);
+    for (int r = 0; result && r < chunk.rows.size(); r++)
+    {
+      _data->recordStart = chunk.offsets.at(r);
+      if (! (chunk.valid.at(r) ? _data->parseRecord(chunk.rows.at(r))
+                                : _data->parseInvalid(chunk.rows.at(r))))
+      {
+        _msghandler->message(QtWarningMsg, tr("Parsing Error"),
+                             tr("<p>Error parsing the data from %1: %2")
+                               .arg(filename, describe(_data->_issues.last())));
+        result = false;
+      }
+    }
+    if (progress)
+    {
+      progress->setValue(chunk.offset + chunk.length);
+      if (progress->wasCanceled())
+        result = false;
+    }
+  }
+
+  if (file && contents.isEmpty() && data)
+    file->unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+
+  return result;
+}
+
+bool CSVData::loadXlsx(QIODevice &device, const QString &filename, QProgressDialog *progress)
+{
+  QString     progresstext(tr("Loading %1: row %2"));
+  XlsxReader  reader(&device);
+  QStringList row;
+
+  if (! reader.open())
+  {
+    _msghandler->message(QtWarningMsg, tr("Read Error"),
+                         tr("<p>Error Reading %1: %2")
+                           .arg(filename, reader.errorString()));
+    return false;
+  }
+
+  for (qint64 rows = 0; reader.readRow(row); rows++)
+  {
+    if (! _data->parseRecord(row))
+    {
+      _msghandler->message(QtWarningMsg, tr("Parsing Error"),
+                           tr("<p>Error parsing the data from %1: %2")
+                             .arg(filename, describe(_data->_issues.last())));
+      return false;
+    }
+
+    if (progress)
+    {
+      if (progress->wasCanceled())
+        return false;
+      if ((rows % 10000) == 0)
+      {
+        progress->setValue(reader.pos());
+        progress->setLabelText(progresstext.arg(filename).arg(rows));
+      }
+    }
+  }
+
+  if (! reader.errorString().isEmpty())
+  {
+    _msghandler->message(QtWarningMsg, tr("Read Error"),
+                         tr("<p>Error Reading %1: %2")
+                           .arg(filename, reader.errorString()));
+    return false;
+  }
+
+  return true;
+}
+
 YAbstractMessageHandler *CSVData::messageHandler() const
 {
   return _msghandler;
 }
 
+CSVData::ParsePolicy CSVData::parsePolicy() const
+{
+  return _parsePolicy;
+}
+
+void CSVData::setParsePolicy(ParsePolicy policy)
+{
+  _parsePolicy = policy;
+}
+
+QString CSVData::parsePolicyToName(ParsePolicy policy)
+{
+  QString str = "Keep";
+  if (policy == SkipBadRows)
+    str = "Skip";
+  else if (policy == QuarantineBadRows)
+    str = "Quarantine";
+  else if (policy == AbortOnBadRow)
+    str = "Abort";
+  return str;
+}
+
+CSVData::ParsePolicy CSVData::nameToParsePolicy(const QString &name)
+{
+  if (name.compare("Skip", Qt::CaseInsensitive) == 0)
+    return SkipBadRows;
+  else if (name.compare("Quarantine", Qt::CaseInsensitive) == 0)
+    return QuarantineBadRows;
+  else if (name.compare("Abort", Qt::CaseInsensitive) == 0)
+    return AbortOnBadRow;
+  return KeepBadRows;
+}
+
+QList<QStringList> CSVData::quarantined() const
+{
+  if (_data)
+    return _data->_quarantine;
+
+  return QList<QStringList>();
+}
+
+QString CSVData::describe(const CSVParseIssue &issue)
+{
+  QString kind;
+  switch (issue.kind)
+  {
+    case CSVParseIssue::UnterminatedQuote:
+      kind = tr("unterminated quote");
+      break;
+    case CSVParseIssue::TooFewColumns:
+      kind = tr("too few columns");
+      break;
+    case CSVParseIssue::TooManyColumns:
+      kind = tr("too many columns");
+      break;
+    case CSVParseIssue::InvalidRecord:
+      kind = tr("not a valid JSON object");
+      break;
+  }
+
+  return tr("Record %1 at byte %2: %3 (expected %4 columns, found %5)")
+           .arg(issue.row + 1).arg(issue.offset).arg(kind)
+           .arg(issue.expected).arg(issue.actual);
+}
+
 void CSVData::setMessageHandler(YAbstractMessageHandler *handler)
 {
   _msghandler = handler;
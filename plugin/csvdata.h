@@ -12,13 +12,32 @@
 #define __CSVDATA_H__
 
 #include <QObject>
+#include <QPair>
 #include <QString>
 #include <QStringList>
+#include <QVector>
 
 class CSVDataPrivate;
+class QIODevice;
+class QProgressDialog;
 class QWidget;
 class YAbstractMessageHandler;
 
+// one malformed record found while parsing; kept small so a badly broken
+// file costs a few bytes per bad row and a clean file costs nothing
+class CSVParseIssue
+{
+  public:
+    enum Kind { UnterminatedQuote, TooFewColumns, TooManyColumns, InvalidRecord };
+
+    qint64 offset;   // byte offset of the start of the record
+    int    row;      // record number in the file, 0-based, headers included
+    int    expected; // column count
+    int    actual;
+    Kind   kind;
+};
+Q_DECLARE_TYPEINFO(CSVParseIssue, Q_PRIMITIVE_TYPE);
+
 class CSVData : public QObject
 {
   Q_OBJECT
@@ -29,23 +48,46 @@ class CSVData : public QObject
             const QChar delim  = ',');
     virtual ~CSVData();
 
+    enum ParsePolicy { KeepBadRows, SkipBadRows, QuarantineBadRows, AbortOnBadRow };
+
     unsigned int             columns();
     QChar                    delimiter()       const;
     bool                     firstRowHeaders() const;
+    QList<QPair<int, int> >  fixedWidthLayout() const;
     QString                  header(int);
+    QStringList              jsonColumns()     const;
+    QVector<CSVParseIssue>   issues()          const;
     bool                     load(QString filename, QWidget *parent = 0);
+    bool                     load(QIODevice *device, const QString &name,
+                                  QWidget *parent = 0);
     YAbstractMessageHandler *messageHandler()  const;
+    ParsePolicy              parsePolicy()     const;
+    QList<QStringList>       quarantined()     const;
     void         setDelimiter(const QChar delim);
     void         setFirstRowHeaders(bool y);
+    void         setFixedWidthLayout(const QList<QPair<int, int> > &layout);
+    void         setJsonColumns(const QStringList &columns);
     void         setMessageHandler(YAbstractMessageHandler *handler);
+    void         setParsePolicy(ParsePolicy policy);
     unsigned int rows();
     QString      value(int row, int column);
 
+    static QString     describe(const CSVParseIssue &issue);
+    static ParsePolicy nameToParsePolicy(const QString &name);
+    static QString     parsePolicyToName(ParsePolicy policy);
+
   protected:
+    bool loadJsonLines(QIODevice &device, const QString &filename, QProgressDialog *progress);
+    bool loadXlsx(QIODevice &device, const QString &filename, QProgressDialog *progress);
+    void reload();
+
     CSVDataPrivate          *_data;
     QChar                    _delimiter;
     bool                     _firstRowHeaders;
+    QList<QPair<int, int> >  _fixedWidth;
+    QStringList              _jsonColumns;
     YAbstractMessageHandler *_msghandler;
+    ParsePolicy              _parsePolicy;
 };
 
 #endif
@@ -0,0 +1,149 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvimportpipeline.h"
+
+#include <QMutexLocker>
+#include <QThread>
+
+#include "csvattachmentloader.h"
+#include "csvdata.h"
+
+#define DEBUG false
+
+class CSVTransformThread : public QThread
+{
+  public:
+    CSVTransformThread(CSVImportPipeline *pipeline)
+      : _pipeline(pipeline)
+    {
+    }
+
+  protected:
+    virtual void run()
+    {
+      while (_pipeline->transform())
+        ;
+    }
+
+    CSVImportPipeline *_pipeline;
+};
+
+/* Bind rows first through last - 1. With no worker count given, use all
+   but one of the cores, leaving that one to the thread writing the rows.
+ */
+CSVImportPipeline::CSVImportPipeline(CSVImportPlan *plan, CSVData *data,
+                                     int first, int last, int workers,
+                                     const CSVAttachmentLoader *loader)
+  : _chunkRows(ChunkRows),
+    _claimed(0),
+    _consumed(0),
+    _data(data),
+    _first(first),
+    _last(last),
+    _loader(loader),
+    _plan(plan),
+    _ready(Depth),
+    _slots(Depth),
+    _stopped(false)
+{
+  if (_loader && _loader->isNeeded())
+    _chunkRows = AttachmentChunkRows;
+  else
+    _loader = 0;
+
+  _chunks = qMax(last - first + _chunkRows - 1, 0) / _chunkRows;
+  if (workers <= 0)
+    workers = QThread::idealThreadCount() - 1;
+  workers = qBound(1, workers, qMax(_chunks, 1));
+
+  if (DEBUG)
+    qDebug("CSVImportPipeline::CSVImportPipeline() %d chunks, %d workers",
+           _chunks, workers);
+
+  for (int i = 0; i < workers; i++)
+  {
+    _workers.append(new CSVTransformThread(this));
+    _workers.last()->start();
+  }
+}
+
+CSVImportPipeline::~CSVImportPipeline()
+{
+  stop();
+  for (int i = 0; i < _workers.size(); i++)
+  {
+    _workers.at(i)->wait();
+    delete _workers.at(i);
+  }
+}
+
+// the next chunk of bound rows, in row order; false when all are taken
+bool CSVImportPipeline::next(QList<CSVImportRow> &rows)
+{
+  QMutexLocker lock(&_mutex);
+  if (_consumed >= _chunks)
+    return false;
+
+  int slot = _consumed % Depth;
+  while (! _ready.testBit(slot) && ! _stopped)
+    _changed.wait(&_mutex);
+  if (_stopped)
+    return false;
+
+  rows = _slots.at(slot);
+  _slots[slot].clear();
+  _ready.clearBit(slot);
+  _consumed++;
+  _changed.wakeAll();
+
+  return true;
+}
+
+// abandon the rows not yet taken, e.g. when the import is canceled
+void CSVImportPipeline::stop()
+{
+  QMutexLocker lock(&_mutex);
+  _stopped = true;
+  _changed.wakeAll();
+}
+
+// bind one chunk; called by the workers until it returns false
+bool CSVImportPipeline::transform()
+{
+  QMutexLocker lock(&_mutex);
+  while (! _stopped && _claimed < _chunks && _claimed >= _consumed + Depth)
+    _changed.wait(&_mutex);
+  if (_stopped || _claimed >= _chunks)
+    return false;
+
+  int chunk = _claimed++;
+  lock.unlock();
+
+  int first = _first + chunk * _chunkRows;
+  int last  = qMin(first + _chunkRows, _last);
+  QList<CSVImportRow> rows;
+  rows.reserve(last - first);
+  for (int r = first; r < last; r++)
+  {
+    CSVImportRow row;
+    _plan->bindRow(_data, r, row);
+    if (_loader)
+      _loader->load(row);
+    rows.append(row);
+  }
+
+  lock.relock();
+  _slots[chunk % Depth] = rows;
+  _ready.setBit(chunk % Depth);
+  _changed.wakeAll();
+
+  return true;
+}
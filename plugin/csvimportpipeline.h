@@ -0,0 +1,70 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVIMPORTPIPELINE_H__
+#define __CSVIMPORTPIPELINE_H__
+
+#include <QBitArray>
+#include <QList>
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "csvimportplan.h"
+
+class CSVAttachmentLoader;
+class CSVData;
+class QThread;
+
+/* Binds the rows of a CSVData with a CSVImportPlan on worker threads while
+   the caller writes the rows already bound. Workers take chunks of rows in
+   turn and fill a ring of Depth slots; next() hands the chunks back in row
+   order. A worker waits when it would get more than Depth chunks ahead of
+   the caller, which bounds the memory the bound rows take.
+   Given a CSVAttachmentLoader, the workers also read the files the rows
+   refer to, in chunks of AttachmentChunkRows so the files held ahead of
+   the caller stay few. Writing stays with the caller; only a
+   CSVParallelWriter moves the database work to other threads.
+ */
+class CSVImportPipeline
+{
+  public:
+    static const int AttachmentChunkRows = 32;
+    static const int ChunkRows = 1000;
+    static const int Depth     = 8;
+
+    CSVImportPipeline(CSVImportPlan *plan, CSVData *data, int first, int last,
+                      int workers = 0, const CSVAttachmentLoader *loader = 0);
+    virtual ~CSVImportPipeline();
+
+    bool next(QList<CSVImportRow> &rows);
+    void stop();
+    bool transform();
+
+  protected:
+    int                          _chunkRows;
+    int                          _chunks;
+    int                          _claimed;  // next chunk for a worker
+    int                          _consumed; // next chunk for next()
+    CSVData                     *_data;
+    int                          _first;
+    int                          _last;
+    const CSVAttachmentLoader   *_loader;
+    CSVImportPlan               *_plan;
+    QBitArray                    _ready;
+    QVector<QList<CSVImportRow> > _slots;
+    bool                         _stopped;
+    QList<QThread*>              _workers;
+
+    QMutex                       _mutex;
+    QWaitCondition               _changed;
+};
+
+#endif
@@ -0,0 +1,384 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvimportplan.h"
+
+#include <QMap>
+#include <QSqlError>
+#include <QSqlQuery>
+
+#include "csvdata.h"
+
+#define DEBUG false
+
+CSVImportPlan::CSVImportPlan(const CSVMap &map, const QSqlDatabase &db)
+  : _action(map.action()),
+    _db(db),
+    _mimeTypeColumn(-1),
+    _table(map.table())
+{
+  bool needMimeType  = false;
+  bool haveMimeType  = false;
+
+  QList<CSVMapField> fields = map.fields();
+  for (int i = 0; i < fields.size(); i++)
+  {
+    if (fields.at(i).action() == CSVMapField::Action_Default)
+      continue;
+
+    _fields.append(fields.at(i));
+    _columns.append(fields.at(i).name());
+    _ops.append(compile(fields.at(i)));
+
+    if (fields.at(i).name() == "file_mime_type")
+      haveMimeType = true;
+    if (fields.at(i).action() == CSVMapField::Action_SetColumnFromDataFile &&
+        fields.at(i).fileType() == CSVMapField::TYPE_FILE)
+      needMimeType = true;
+  }
+
+  if (needMimeType && ! haveMimeType)
+  {
+    _mimeTypeColumn = _columns.size();
+    _columns.append("file_mime_type");
+  }
+
+  _keys.resize(_columns.size());
+  for (int i = 0; i < _fields.size(); i++)
+    _keys.setBit(i, _fields.at(i).isKey());
+}
+
+CSVImportPlan::~CSVImportPlan()
+{
+  reset();
+}
+
+// forget the prepared statements, e.g. after the connection was reopened
+void CSVImportPlan::reset()
+{
+  QHash<QBitArray, CSVImportStatement>::iterator it;
+  for (it = _statements.begin(); it != _statements.end(); ++it)
+    delete it.value().query;
+  _statements.clear();
+}
+
+CSVMapField::FileType CSVImportPlan::fileType(int col) const
+{
+  if (col < _fields.size() &&
+      _fields.at(col).action() == CSVMapField::Action_SetColumnFromDataFile)
+    return _fields.at(col).fileType();
+
+  return CSVMapField::TYPE_NA;
+}
+
+/* Reduce the actions of a field to the data columns to look in and the
+   value to use when they are all null, so bindRow() need not work through
+   the actions again for every row.
+ */
+CSVImportOp CSVImportPlan::compile(const CSVMapField &field)
+{
+  CSVImportOp op;
+  op.column    = -1;
+  op.columnAlt = -1;
+  op.fallback  = QVariant(QString {});
+  op.omit      = false;
+
+  switch (field.action())
+  {
+    case CSVMapField::Action_UseColumn:
+      op.column = field.column() - 1;
+      switch (field.ifNullAction())
+      {
+        case CSVMapField::UseDefault:
+          op.omit = true;
+          break;
+        case CSVMapField::UseEmptyString:
+          op.fallback = QVariant(QString(""));
+          break;
+        case CSVMapField::UseAlternateValue:
+          op.fallback = QVariant(field.valueAlt());
+          break;
+        case CSVMapField::UseAlternateColumn:
+          op.columnAlt = field.columnAlt() - 1;
+          switch (field.ifNullActionAlt())
+          {
+            case CSVMapField::UseDefault:
+              op.omit = true;
+              break;
+            case CSVMapField::UseEmptyString:
+              op.fallback = QVariant(QString(""));
+              break;
+            case CSVMapField::UseAlternateValue:
+              op.fallback = QVariant(field.valueAlt());
+              break;
+            default: // Nothing
+              break;
+          }
+          break;
+        default: // Nothing
+          break;
+      }
+      break;
+    case CSVMapField::Action_SetColumnFromDataFile:
+      op.column = field.column() - 1;
+      break;
+    case CSVMapField::Action_UseEmptyString:
+      op.fallback = QVariant(QString(""));
+      break;
+    case CSVMapField::Action_UseAlternateValue:
+      op.fallback = QVariant(field.valueAlt());
+      break;
+    default: // UseNull
+      break;
+  }
+
+  return op;
+}
+
+/* Fill out with the values the map gives for a row of data. Columns whose
+   value comes from a data file get the file name; a CSVAttachmentLoader
+   replaces it with the file contents.
+ */
+void CSVImportPlan::bindRow(CSVData *data, int row, CSVImportRow &out) const
+{
+  out.row = row;
+  out.values.fill(QVariant(), _columns.size());
+  out.omitted.fill(false, _columns.size());
+  out.warnings.clear();
+  if (_mimeTypeColumn >= 0)
+    out.omitted.setBit(_mimeTypeColumn);
+
+  for (int i = 0; i < _ops.size(); i++)
+  {
+    const CSVImportOp &op = _ops.at(i);
+    QString value;
+    if (op.column >= 0)
+      value = data->value(row, op.column);
+    if (value.isNull() && op.columnAlt >= 0)
+      value = data->value(row, op.columnAlt);
+
+    if (! value.isNull())
+      out.values[i] = QVariant(value);
+    else if (op.omit)
+      out.omitted.setBit(i);
+    else
+      out.values[i] = op.fallback;
+  }
+}
+
+/* Return the SQL type of a target column, without modifiers, so values
+   can be cast to it where the server cannot infer it from context.
+ */
+QString CSVImportPlan::columnType(int col)
+{
+  if (_columnTypes.isEmpty())
+  {
+    QMap<QString, QString> types;
+    QSqlQuery qry(_db);
+    qry.prepare("SELECT attname, format_type(atttypid, NULL)"
+                "  FROM pg_attribute"
+                " WHERE attrelid = CAST(? AS regclass)"
+                "   AND attnum > 0 AND NOT attisdropped;");
+    qry.addBindValue(_table);
+    if (qry.exec())
+      while (qry.next())
+        types.insert(qry.value(0).toString(), qry.value(1).toString());
+    else if (DEBUG)
+      qDebug("CSVImportPlan::columnType() %s",
+             qPrintable(qry.lastError().text()));
+
+    for (int i = 0; i < _columns.size(); i++)
+      _columnTypes.append(types.value(_columns.at(i), "text"));
+  }
+
+  return _columnTypes.at(col);
+}
+
+/* Decide whether a row can be written at all, without touching the database.
+ */
+CSVImportPlan::Result CSVImportPlan::check(const CSVImportRow &row, QString *errmsg) const
+{
+  bool haveValue = false;
+  bool haveKey   = false;
+  for (int i = 0; i < _columns.size(); i++)
+  {
+    if (row.omitted.testBit(i))
+      continue;
+    if (_keys.testBit(i))
+      haveKey = true;
+    if (! _keys.testBit(i) || _action != CSVMap::Update)
+      haveValue = true;
+  }
+
+  if (! haveValue)
+  {
+    if (errmsg)
+      *errmsg = QString("IGNORED Record %1: There are no columns to %2")
+                  .arg(row.row + 1)
+                  .arg(_action == CSVMap::Update ? "update" : "append");
+    return Ignored;
+  }
+
+  if (! haveKey && _action != CSVMap::Insert)
+  {
+    if (errmsg)
+      *errmsg = QString("No Key defined in Altas Map.");
+    return Failed;
+  }
+
+  return Written;
+}
+
+CSVImportPlan::Result CSVImportPlan::exec(const CSVImportRow &row, QString *errmsg,
+                                          QString *code)
+{
+  if (code)
+    code->clear();
+
+  Result result = check(row, errmsg);
+  if (result != Written)
+    return result;
+
+  CSVImportStatement *stmt = statement(row.omitted, errmsg);
+  if (! stmt)
+    return Failed;
+
+  for (int b = 0; b < stmt->binds.size(); b++)
+    stmt->query->bindValue(b, row.values.at(stmt->binds.at(b)));
+
+  if (! stmt->query->exec())
+  {
+    if (errmsg)
+      *errmsg = QString("ERROR Record %1: %2")
+                  .arg(row.row + 1).arg(stmt->query->lastError().text());
+    if (code)
+      *code = stmt->query->lastError().nativeErrorCode();
+    return Failed;
+  }
+
+  return Written;
+}
+
+/* The ON CONFLICT clause turning an insert into an Upsert: rows whose keys
+   already exist get their other columns updated instead.
+ */
+QString CSVImportPlan::conflictClause(const QBitArray &omitted) const
+{
+  QStringList keys;
+  QStringList sets;
+  for (int i = 0; i < _columns.size(); i++)
+  {
+    if (omitted.testBit(i))
+      continue;
+    if (_keys.testBit(i))
+      keys.append(_columns.at(i));
+    else
+      sets.append(QString("%1 = EXCLUDED.%1").arg(_columns.at(i)));
+  }
+
+  if (sets.isEmpty())
+    return QString(" ON CONFLICT (%1) DO NOTHING").arg(keys.join(", "));
+
+  return QString(" ON CONFLICT (%1) DO UPDATE SET %2")
+           .arg(keys.join(", "), sets.join(", "));
+}
+
+/* Return the prepared statement for rows that omit the given columns,
+   building and preparing it the first time that shape is seen.
+ */
+CSVImportStatement *CSVImportPlan::statement(const QBitArray &omitted, QString *errmsg)
+{
+  QHash<QBitArray, CSVImportStatement>::iterator it = _statements.find(omitted);
+  if (it != _statements.end())
+    return &it.value();
+
+  CSVImportStatement stmt;
+  QString sql = statementText(omitted, stmt.binds);
+
+  if (DEBUG)
+    qDebug("CSVImportPlan::statement() preparing %s", qPrintable(sql));
+
+  stmt.query = new QSqlQuery(_db);
+  if (! stmt.query->prepare(sql))
+  {
+    if (errmsg)
+      *errmsg = QString("ERROR Preparing %1: %2")
+                  .arg(sql, stmt.query->lastError().text());
+    delete stmt.query;
+    return 0;
+  }
+
+  return &_statements.insert(omitted, stmt).value();
+}
+
+/* The SQL writing one row that omits the given columns. binds gets the plan
+   column for each placeholder; placeholders are ? or, with numbered, $1, $2
+   and so on as libpq wants them.
+ */
+QString CSVImportPlan::statementText(const QBitArray &omitted, QVector<int> &binds,
+                                     bool numbered) const
+{
+  QVector<int> valueBinds;
+  QVector<int> keyBinds;
+  for (int i = 0; i < _columns.size(); i++)
+  {
+    if (omitted.testBit(i))
+      continue;
+
+    if (_keys.testBit(i))
+    {
+      keyBinds.append(i);
+      if (_action == CSVMap::Update)
+        continue;
+    }
+    valueBinds.append(i);
+  }
+
+  binds = valueBinds;
+  if (_action == CSVMap::Update || _action == CSVMap::Append)
+    binds += keyBinds;
+
+  QStringList names;
+  QStringList placeholders;
+  QStringList sets;
+  QStringList wheres;
+  for (int b = 0; b < binds.size(); b++)
+  {
+    QString placeholder = numbered ? QString("$%1").arg(b + 1) : QString("?");
+    const QString &column = _columns.at(binds.at(b));
+    if (b < valueBinds.size())
+    {
+      names.append(column);
+      placeholders.append(placeholder);
+      sets.append(column + "=" + placeholder);
+    }
+    else
+      wheres.append(column + "=" + placeholder);
+  }
+
+  switch (_action)
+  {
+    case CSVMap::Update:
+      return QString("UPDATE %1 SET %2 WHERE %3;")
+               .arg(_table, sets.join(", "), wheres.join(" AND "));
+    case CSVMap::Append:
+      return QString("INSERT INTO %1 (%2) SELECT %3"
+                     " WHERE NOT EXISTS (SELECT 1 FROM %1 WHERE %4);")
+               .arg(_table, names.join(", "), placeholders.join(", "),
+                    wheres.join(" AND "));
+    case CSVMap::Upsert:
+      return QString("INSERT INTO %1 (%2) VALUES (%3)%4;")
+               .arg(_table, names.join(", "), placeholders.join(", "),
+                    conflictClause(omitted));
+    default:
+      return QString("INSERT INTO %1 (%2) VALUES (%3);")
+               .arg(_table, names.join(", "), placeholders.join(", "));
+  }
+}
@@ -0,0 +1,104 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVIMPORTPLAN_H__
+#define __CSVIMPORTPLAN_H__
+
+#include <QBitArray>
+#include <QHash>
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+#include "csvmap.h"
+
+class CSVData;
+class QSqlQuery;
+
+// one data row converted to values for the columns of a CSVImportPlan
+class CSVImportRow
+{
+  public:
+    int               row;      // 0-based row in the CSVData
+    QVector<QVariant> values;   // one per plan column
+    QBitArray         omitted;  // columns left to the table default
+    QStringList       warnings; // e.g. data files that could not be loaded
+};
+
+/* How bindRow() fills one column: the value in data column column, else
+   the value in columnAlt, else fallback or, if omit is set, the default.
+ */
+class CSVImportOp
+{
+  public:
+    int      column;            // 0-based data column or -1
+    int      columnAlt;         // 0-based data column or -1
+    QVariant fallback;
+    bool     omit;
+};
+
+class CSVImportStatement
+{
+  public:
+    QSqlQuery   *query;
+    QVector<int> binds;         // plan column for each ? placeholder
+};
+
+/* The per-import form of a CSVMap: the target columns, their key flags, the
+   rules filling each column compiled to a CSVImportOp, and the INSERT/UPDATE
+   statements, prepared once and reused for every row.
+   Rows that leave different columns to their defaults need differently
+   shaped statements, so there is one prepared statement per shape.
+ */
+class CSVImportPlan
+{
+  public:
+    enum Result { Written, Ignored, Failed };
+
+    CSVImportPlan(const CSVMap &map, const QSqlDatabase &db = QSqlDatabase::database());
+    virtual ~CSVImportPlan();
+
+    CSVMap::Action action()      const { return _action; }
+    int            columnCount() const { return _columns.size(); }
+    QString        columnName(int col) const { return _columns.at(col); }
+    CSVMapField::FileType fileType(int col) const;
+    QString        columnType(int col);
+    bool           isKey(int col) const { return _keys.testBit(col); }
+    int            mimeTypeColumn() const { return _mimeTypeColumn; }
+    QString        table()       const { return _table; }
+
+    void   bindRow(CSVData *data, int row, CSVImportRow &out) const;
+    QString conflictClause(const QBitArray &omitted) const;
+    Result check(const CSVImportRow &row, QString *errmsg) const;
+    Result exec(const CSVImportRow &row, QString *errmsg, QString *code = 0);
+    QSqlDatabase database() const { return _db; }
+    void   reset();
+    QString statementText(const QBitArray &omitted, QVector<int> &binds,
+                          bool numbered = false) const;
+
+  protected:
+    CSVImportStatement *statement(const QBitArray &omitted, QString *errmsg);
+    static CSVImportOp  compile(const CSVMapField &field);
+
+    CSVMap::Action      _action;
+    QStringList         _columns;
+    QStringList         _columnTypes;
+    QSqlDatabase        _db;
+    QList<CSVMapField>  _fields;
+    QBitArray           _keys;
+    int                 _mimeTypeColumn;
+    QVector<CSVImportOp> _ops;      // one per field
+    QHash<QBitArray, CSVImportStatement> _statements;
+    QString             _table;
+};
+
+#endif
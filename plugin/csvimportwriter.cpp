@@ -0,0 +1,535 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvimportwriter.h"
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QSqlDriver>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+
+#include <libpq-fe.h>
+
+#include "csvarraywriter.h"
+#include "csvbinarycopywriter.h"
+#include "csvpipelinewriter.h"
+#include "csvstagingwriter.h"
+#include "csvvalueswriter.h"
+
+#define DEBUG false
+
+CSVImportWriter::CSVImportWriter(CSVImportPlan *plan, int batchSize)
+  : _batchSize(qMax(batchSize, 1)),
+    _commitRows(0),
+    _commitSeconds(0),
+    _done(0),
+    _failed(0),
+    _ignored(0),
+    _lastCommitted(-1),
+    _lastRow(-1),
+    _pending(0),
+    _plan(plan),
+    _restart(false),
+    _skipped(0),
+    _written(0)
+{
+}
+
+CSVImportWriter::~CSVImportWriter()
+{
+}
+
+/* Return a new writer for the map's method, or one writing a statement per
+   row if the method does not apply to the map's action or the plan's
+   database connection.
+ */
+CSVImportWriter *CSVImportWriter::create(CSVImportPlan *plan, const CSVMap &map)
+{
+  bool copy = CSVCopyWriter::connection(plan->database()) != 0;
+  switch (map.method())
+  {
+    case CSVMap::Values:
+      if (map.action() != CSVMap::Update)
+        return new CSVValuesWriter(plan, map.batchSize());
+      break;
+    case CSVMap::Copy:
+      if (map.action() == CSVMap::Insert && copy)
+        return new CSVCopyWriter(plan, map.batchSize());
+      break;
+    case CSVMap::BinaryCopy:
+      if (map.action() == CSVMap::Insert && copy)
+        return new CSVBinaryCopyWriter(plan, map.batchSize());
+      break;
+    case CSVMap::Staging:
+      if (copy)
+        return new CSVStagingWriter(plan, map.batchSize());
+      break;
+    case CSVMap::Pipeline:
+      if (copy)
+        return new CSVPipelineWriter(plan, map.batchSize());
+      break;
+    case CSVMap::Array:
+      return new CSVArrayWriter(plan, map.batchSize());
+    default:
+      break;
+  }
+
+  return new CSVImportWriter(plan);
+}
+
+bool CSVImportWriter::add(const CSVImportRow &row)
+{
+  QString errmsg;
+  switch (_plan->check(row, &errmsg))
+  {
+    case CSVImportPlan::Ignored:
+      ignore(row.row, errmsg);
+      return true;
+    case CSVImportPlan::Failed:
+      fail(row.row, errmsg);
+      return false;
+    default:
+      break;
+  }
+
+  bool result = true;
+  if (! _rows.isEmpty() && _rows.first().omitted != row.omitted)
+    result = flush();
+
+  _rows.append(row);
+  if (_rows.size() >= _batchSize)
+    result = flush() && result;
+
+  return result;
+}
+
+/* Commit the open transaction and, if reopen is set, start the next one.
+   Only meaningful with a commit interval.
+ */
+bool CSVImportWriter::commit(bool reopen)
+{
+  if (! isTransactional())
+    return true;
+
+  bool result = execSql("COMMIT;");
+  for (int attempt = 0; ! result && attempt < MaxRetries && connectionLost(); attempt++)
+  {
+    retryDelay(attempt);
+    if (reconnect())
+    {
+      replay();
+      result = execSql("COMMIT;");
+    }
+  }
+  if (result)
+    _lastCommitted = _lastRow;
+  else
+    failUncommitted();
+  _pending = 0;
+  _uncommitted.clear();
+  _uncommittedFailed.clear();
+  _sinceCommit.restart();
+
+  if (reopen)
+    result = execSql("BEGIN;") && result;
+
+  return result;
+}
+
+bool CSVImportWriter::flush()
+{
+  if (_rows.isEmpty())
+    return true;
+
+  int  failed = _failed;
+  QList<CSVImportRow> rows = _rows;
+  _done = 0;
+  _restart = false;
+  bool sent   = tryBatch(rows);
+  for (int attempt = 0; ! sent && attempt < MaxRetries && (_restart || connectionLost());
+       attempt++)
+  {
+    rows  = rows.mid(_done);
+    _done = 0;
+    bool restart = _restart && ! connectionLost();
+    _restart = false;
+    retryDelay(attempt);
+    if (restart ? restartTransaction() : reconnect())
+    {
+      replay();
+      sent = tryBatch(rows);
+    }
+  }
+  if (! sent)
+    bisect(rows.mid(_done));
+  bool result = _failed == failed;
+
+  _lastRow  = _rows.last().row;
+  _pending += _rows.size();
+  if (isTransactional())
+    _uncommitted += _rows;
+  _rows.clear();
+
+  if (! isTransactional())
+    _lastCommitted = _lastRow;
+  else if ((_commitRows    > 0 && _pending >= _commitRows) ||
+           (_commitSeconds > 0 && _sinceCommit.hasExpired(_commitSeconds * 1000)))
+    result = commit() && result;
+
+  return result;
+}
+
+// the transaction of the plan's connection belongs to the caller
+void CSVImportWriter::rollback()
+{
+}
+
+/* Commit every rows rows or seconds seconds, whichever comes first; 0 for
+   both turns transactions off. The caller opens the first transaction.
+ */
+void CSVImportWriter::setCommitInterval(int rows, int seconds)
+{
+  _commitRows    = qMax(rows, 0);
+  _commitSeconds = qMax(seconds, 0);
+  _pending       = 0;
+  _sinceCommit.start();
+}
+
+QList<CSVImportError> CSVImportWriter::takeErrors()
+{
+  QList<CSVImportError> errors = _errors;
+  _errors.clear();
+  return errors;
+}
+
+/* Find the rows of a failed batch that cannot be written by splitting it in
+   halves. A half that writes cleanly is kept; a failing half is split again
+   until single rows remain, which are written with the plan's statements
+   to report their errors. When the first half succeeds the second must hold
+   the failure, so it is split without being tried whole. Rows a failed try
+   still committed, counted by _done, are not written again.
+ */
+void CSVImportWriter::bisect(const QList<CSVImportRow> &rows)
+{
+  if (rows.size() <= 1)
+  {
+    writeEach(rows);
+    return;
+  }
+
+  QList<CSVImportRow> first  = rows.mid(0, rows.size() / 2);
+  QList<CSVImportRow> second = rows.mid(rows.size() / 2);
+
+  _done = 0;
+  if (! tryBatch(first))
+  {
+    bisect(first.mid(_done));
+    _done = 0;
+    if (tryBatch(second))
+      return;
+    second = second.mid(_done);
+  }
+  bisect(second);
+}
+
+/* Write rows as one batch. Inside a transaction the batch gets a savepoint
+   so a failure undoes only the batch, unless it is a single row and the
+   writer gives rows savepoints of their own.
+ */
+bool CSVImportWriter::tryBatch(const QList<CSVImportRow> &rows)
+{
+  bool savepoint = isTransactional() && ! (rows.size() == 1 && rowSavepoints());
+  if (savepoint)
+    execSql("SAVEPOINT csvimp_batch;");
+
+  QString errmsg;
+  bool result = writeBatch(rows, &errmsg);
+
+  if (savepoint)
+  {
+    if (! result)
+      execSql("ROLLBACK TO SAVEPOINT csvimp_batch;");
+    execSql("RELEASE SAVEPOINT csvimp_batch;");
+  }
+
+  if (! result && DEBUG)
+    qDebug("CSVImportWriter::tryBatch() %d rows starting at record %d "
+           "failed: %s", rows.size(), rows.first().row + 1, qPrintable(errmsg));
+
+  return result;
+}
+
+/* Write the rows one statement at a time. Inside a transaction several rows
+   share the batch's savepoint, so the first failure fails the batch and
+   bisect() finds the row; a single row gets its own savepoint. If the
+   connection goes away, or a conflict means the transaction must start
+   over, the batch fails so flush() can send it again: in a transaction
+   the rows written so far are undone and not counted; without one they
+   are committed, so _done tells flush() to skip them.
+ */
+bool CSVImportWriter::writeBatch(const QList<CSVImportRow> &rows, QString *errmsg)
+{
+  int written = _written;
+  int ignored = _ignored;
+  int failed  = _failed;
+  int errors  = _errors.size();
+
+  int stopped = -1;
+  writeEach(rows, &stopped, rows.size() == 1);
+  if (stopped < 0)
+    return true;
+
+  if (errmsg)
+    *errmsg = QString("Stopped at record %1").arg(rows.at(stopped).row + 1);
+  if (isTransactional())
+  {
+    _written = written;
+    _ignored = ignored;
+    _failed  = failed;
+    _errors  = _errors.mid(0, errors);
+  }
+  else
+    _done = stopped;
+
+  return false;
+}
+
+// the per-row statements keep a failing row from aborting the transaction
+bool CSVImportWriter::rowSavepoints() const
+{
+  return true;
+}
+
+bool CSVImportWriter::execSql(const QString &sql)
+{
+  QSqlQuery qry(_plan->database());
+  if (qry.exec(sql))
+    return true;
+
+  _errors.append(CSVImportError(CSVImportError::Message, -1,
+                                QString("ERROR %1 %2").arg(sql, qry.lastError().text()),
+                                qry.lastError().nativeErrorCode()));
+  return false;
+}
+
+void CSVImportWriter::fail(int row, const QString &message, const QString &code)
+{
+  _failed++;
+  _errors.append(CSVImportError(CSVImportError::Failed, row, message, code));
+  if (isTransactional())
+    _uncommittedFailed.insert(row);
+}
+
+void CSVImportWriter::ignore(int row, const QString &message)
+{
+  _ignored++;
+  _errors.append(CSVImportError(CSVImportError::Ignored, row, message));
+}
+
+/* Write rows one statement at a time. With savepoints, inside a transaction
+   each row gets one so a failure does not abort the rest. Given stopped,
+   stop at the first row that cannot be reported here, leaving it
+   unreported, and set stopped to its index: a row failing because the
+   connection is gone, a conflict in a transaction, which only succeeds
+   when the whole transaction is tried again, or any failure in a
+   transaction without savepoints.
+   Outside a transaction, conflicts are retried here.
+ */
+bool CSVImportWriter::writeEach(const QList<CSVImportRow> &rows, int *stopped,
+                                bool savepoints)
+{
+  bool ok = true;
+  bool savepoint = savepoints && isTransactional();
+  QString errmsg;
+  QString code;
+  for (int i = 0; i < rows.size(); i++)
+  {
+    if (savepoint)
+      execSql("SAVEPOINT csvimp_row;");
+
+    CSVImportPlan::Result result = _plan->exec(rows.at(i), &errmsg, &code);
+    for (int attempt = 0;
+         result == CSVImportPlan::Failed && isTransient(code) &&
+         ! isTransactional() && attempt < MaxRetries;
+         attempt++)
+    {
+      retryDelay(attempt);
+      result = _plan->exec(rows.at(i), &errmsg, &code);
+    }
+
+    switch (result)
+    {
+      case CSVImportPlan::Written:
+        _written++;
+        break;
+      case CSVImportPlan::Ignored:
+        ignore(rows.at(i).row, errmsg);
+        break;
+      default:
+        if (stopped && (connectionLost() ||
+                        (isTransactional() && (! savepoint || isTransient(code)))))
+        {
+          if (isTransactional() && isTransient(code))
+            _restart = true;
+          *stopped = i;
+          return false;
+        }
+        fail(rows.at(i).row, errmsg, code);
+        ok = false;
+        if (savepoint)
+          execSql("ROLLBACK TO SAVEPOINT csvimp_row;");
+    }
+
+    if (savepoint)
+      execSql("RELEASE SAVEPOINT csvimp_row;");
+  }
+
+  return ok;
+}
+
+// whether the plan's connection has gone away
+bool CSVImportWriter::connectionLost() const
+{
+  QSqlDatabase db = _plan->database();
+  if (! db.isOpen() || ! db.driver())
+    return true;
+
+  QVariant handle = db.driver()->handle();
+  if (handle.isValid() && qstrcmp(handle.typeName(), "PGconn*") == 0)
+    return PQstatus(*static_cast<PGconn **>(handle.data())) == CONNECTION_BAD;
+
+  return false;
+}
+
+// serialization failures and deadlocks succeed when tried again
+bool CSVImportWriter::isTransient(const QString &code)
+{
+  return code == "40001" || code == "40P01";
+}
+
+/* The transaction holding the rows since the last commit is gone, so those
+   rows were not written after all; report them as failed.
+ */
+void CSVImportWriter::failUncommitted()
+{
+  for (int r = 0; r < _uncommitted.size(); r++)
+  {
+    int row = _uncommitted.at(r).row;
+    if (_uncommittedFailed.contains(row))
+      continue;
+    fail(row, QString("ERROR Record %1: The transaction holding it could not be committed")
+                .arg(row + 1));
+    _written--;
+  }
+}
+
+// roll back and start the transaction over, e.g. after a serialization failure
+bool CSVImportWriter::restartTransaction()
+{
+  if (! execSql("ROLLBACK;") || ! execSql("BEGIN;"))
+    return false;
+
+  _errors.append(CSVImportError(CSVImportError::Message, -1,
+                                QString("WARNING Restarted the transaction at record %1")
+                                  .arg(_rows.isEmpty() ? 0 : _rows.first().row + 1)));
+  return true;
+}
+
+/* Open the plan's connection again and, inside a transaction, start a new
+   one. Statements prepared on the old connection are gone with it.
+ */
+bool CSVImportWriter::reconnect()
+{
+  QSqlDatabase db = _plan->database();
+  db.close();
+  if (! db.open())
+  {
+    if (DEBUG)
+      qDebug("CSVImportWriter::reconnect() failed: %s",
+             qPrintable(db.lastError().text()));
+    return false;
+  }
+
+  _errors.append(CSVImportError(CSVImportError::Message, -1,
+                                QString("WARNING Reconnected to the database at record %1")
+                                  .arg(_rows.isEmpty() ? 0 : _rows.first().row + 1)));
+  reconnected();
+  if (isTransactional())
+    return execSql("BEGIN;");
+
+  return true;
+}
+
+void CSVImportWriter::reconnected()
+{
+  _plan->reset();
+}
+
+/* Write the rows of the transaction the connection took with it again.
+   They were counted and their errors reported the first time, so only
+   rows that fail now but did not then count, as failed instead of written.
+ */
+void CSVImportWriter::replay()
+{
+  if (_uncommitted.isEmpty())
+    return;
+
+  QList<CSVImportRow> rows;
+  for (int r = 0; r < _uncommitted.size(); r++)
+    if (! _uncommittedFailed.contains(_uncommitted.at(r).row))
+      rows.append(_uncommitted.at(r));
+
+  int written = _written;
+  int ignored = _ignored;
+  int skipped = _skipped;
+  int failed  = _failed;
+  int errors  = _errors.size();
+
+  for (int first = 0; first < rows.size(); first += _batchSize)
+  {
+    QList<CSVImportRow> batch = rows.mid(first, _batchSize);
+    if (! tryBatch(batch))
+      bisect(batch);
+  }
+
+  QList<CSVImportError> replayed = _errors.mid(errors);
+  _errors   = _errors.mid(0, errors);
+  _written  = written;
+  _ignored  = ignored;
+  _skipped  = skipped;
+  _failed   = failed;
+  for (int e = 0; e < replayed.size(); e++)
+  {
+    if (replayed.at(e).kind != CSVImportError::Failed)
+      continue;
+    _errors.append(replayed.at(e));
+    _uncommittedFailed.insert(replayed.at(e).row);
+    _failed++;
+    _written--;
+  }
+}
+
+/* Wait before the given retry, longer each time. Pending events other than
+   user input are handled every so often, so the progress dialog keeps
+   painting without anything the user does running in mid-import.
+ */
+void CSVImportWriter::retryDelay(int attempt)
+{
+  QElapsedTimer waited;
+  waited.start();
+  int delay = qMin(RetryDelayMs << qMin(attempt, 16), int(MaxDelayMs));
+  while (! waited.hasExpired(delay))
+  {
+    QThread::msleep(qMin(qint64(100), delay - waited.elapsed()));
+    QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+  }
+}
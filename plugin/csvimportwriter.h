@@ -0,0 +1,126 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVIMPORTWRITER_H__
+#define __CSVIMPORTWRITER_H__
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+#include "csvimportplan.h"
+
+// a row a writer could not write, or another problem it ran into
+class CSVImportError
+{
+  public:
+    enum Kind { Failed, Ignored, Message };
+
+    CSVImportError(Kind kind = Message, int row = -1,
+                   const QString &message = QString(),
+                   const QString &code = QString())
+      : kind(kind), row(row), code(code), message(message)
+    {
+    }
+
+    Kind    kind;
+    int     row;      // 0-based data row or -1
+    QString code;     // SQLSTATE if the database reported one
+    QString message;
+};
+
+/* Collects rows bound by a CSVImportPlan and sends them to the database.
+   This base class writes one statement per row; subclasses override
+   writeBatch() to send a whole batch at once. A batch only holds rows of
+   the same shape. If a batch fails it is split until the rows that cause
+   the failure are found, so errors are reported against those rows and the
+   rest of the batch is still written.
+
+   By default every batch commits on its own. With a commit interval the
+   caller opens a transaction, each batch runs under a savepoint, and the
+   writer commits and starts a new transaction every so many rows or
+   seconds.
+
+   If a batch fails because the connection is gone, the writer reconnects,
+   waiting longer after each failed attempt, and sends the batch again; in
+   a transaction it first replays the rows the lost transaction held. A row
+   failing on a deadlock or serialization conflict in a transaction has the
+   writer roll back and replay the transaction the same way; outside one
+   the row is simply tried again.
+ */
+class CSVImportWriter
+{
+  public:
+    static const int MaxRetries   = 6;
+    static const int RetryDelayMs = 500;    // doubled for each retry
+    static const int MaxDelayMs   = 30000;
+
+    CSVImportWriter(CSVImportPlan *plan, int batchSize = 1);
+    virtual ~CSVImportWriter();
+
+    static CSVImportWriter *create(CSVImportPlan *plan, const CSVMap &map);
+
+    virtual bool add(const CSVImportRow &row);
+    virtual bool commit(bool reopen = true);
+    virtual bool flush();
+    virtual void rollback();
+    virtual void setCommitInterval(int rows, int seconds = 0);
+
+    int         batchSize() const { return _batchSize; }
+    int         failed()    const { return _failed; }
+    int         ignored()   const { return _ignored; }
+    int         lastCommittedRow() const { return _lastCommitted; }
+    int         skipped()   const { return _skipped; }
+    int         written()   const { return _written; }
+    QList<CSVImportError> takeErrors();
+
+  protected:
+    virtual bool writeBatch(const QList<CSVImportRow> &rows, QString *errmsg);
+    void         bisect(const QList<CSVImportRow> &rows);
+    bool         tryBatch(const QList<CSVImportRow> &rows);
+    virtual bool rowSavepoints() const;
+    bool         writeEach(const QList<CSVImportRow> &rows, int *stopped = 0,
+                           bool savepoints = true);
+    bool         execSql(const QString &sql);
+    void         fail(int row, const QString &message, const QString &code = QString());
+    void         ignore(int row, const QString &message);
+    bool         connectionLost() const;
+    static bool  isTransient(const QString &code);
+    void         failUncommitted();
+    bool         reconnect();
+    bool         restartTransaction();
+    virtual void reconnected();
+    void         replay();
+    static void  retryDelay(int attempt);
+    bool         isTransactional() const { return _commitRows > 0 || _commitSeconds > 0; }
+
+    int                 _batchSize;
+    int                 _commitRows;
+    int                 _commitSeconds;
+    int                 _done;          // rows of a failed batch committed anyway
+    QList<CSVImportError> _errors;
+    int                 _failed;
+    int                 _ignored;
+    int                 _lastCommitted; // -1 before the first commit
+    int                 _lastRow;       // last row sent to the database
+    int                 _pending;       // rows written since the last commit
+    CSVImportPlan      *_plan;
+    bool                _restart;   // a conflict needs the transaction again
+    QList<CSVImportRow> _rows;
+    int                 _skipped;   // Append rows already in the table
+    QList<CSVImportRow> _uncommitted;       // replayed after a reconnect
+    QSet<int>           _uncommittedFailed; // rows of those already reported
+    int                 _written;
+    QElapsedTimer       _sinceCommit;
+};
+
+#endif
@@ -27,9 +27,13 @@ CSVImpPlugin::CSVImpPlugin(QObject *parent)
 {
   _atlasdir      = QString {};
   _atlaswindow   = 0;
+  _commitRows    = -1;
+  _commitSeconds = -1;
   _csvdir        = QString {};
   _csvtoolwindow = 0;
   _msghandler    = 0;
+  _parsePolicy   = CSVData::KeepBadRows;
+  _resume        = false;
 }
 
 QMainWindow *CSVImpPlugin::getCSVAtlasWindow(QWidget *parent, Qt::WindowFlags flags)
@@ -64,6 +68,9 @@ QMainWindow *CSVImpPlugin::getCSVToolWindow(QWidget *parent, Qt::WindowFlags fla
     connect(_csvtoolwindow, SIGNAL(destroyed(QObject*)), this, SLOT(cleanupDestroyedObject(QObject*)));
 
     _csvtoolwindow->sFirstRowHeader(_firstLineIsHeader);
+    _csvtoolwindow->setCommitInterval(_commitRows, _commitSeconds);
+    _csvtoolwindow->setParsePolicy(_parsePolicy);
+    _csvtoolwindow->setResume(_resume);
     _csvtoolwindow->setDir(_csvdir);
     if (_atlasdir.isEmpty())
       _csvtoolwindow->atlasWindow()->setDir(_csvdir);
@@ -148,6 +155,18 @@ bool CSVImpPlugin::openCSV(QString filename)
   return false;
 }
 
+bool CSVImpPlugin::openCSV(QIODevice *device, QString name)
+{
+  CSVToolWindow *csvtool = qobject_cast<CSVToolWindow*>(getCSVToolWindow(qobject_cast<QWidget*>(parent())));
+  if (csvtool && device)
+  {
+    csvtool->deviceOpen(device, name);
+    return true;
+  }
+
+  return false;
+}
+
 void CSVImpPlugin::setAtlasDir(QString dirname)
 {
   if (DEBUG) qDebug("CSVImpPlugin::setAltasDir(%s)", qPrintable(dirname));
@@ -175,6 +194,15 @@ void CSVImpPlugin::setCSVDir(QString dirname)
     _csvtoolwindow->setDir(dirname);
 }
 
+void CSVImpPlugin::setCommitInterval(int rows, int seconds)
+{
+  if (DEBUG) qDebug("CSVImpPlugin::setCommitInterval(%d, %d)", rows, seconds);
+  _commitRows    = rows;
+  _commitSeconds = seconds;
+  if (_csvtoolwindow)
+    _csvtoolwindow->setCommitInterval(rows, seconds);
+}
+
 bool CSVImpPlugin::setFirstLineHeader(bool isheader)
 {
   if (DEBUG) qDebug("CSVImpPlugin::setFirstLineHeader(%d)", isheader);
@@ -207,6 +235,28 @@ void CSVImpPlugin::setInteractive(bool interactive)
   }
 }
 
+/* Set how openCSV() treats malformed records: Keep, Skip, Quarantine
+   (skip them and write them to a file next to the data) or Abort.
+ */
+void CSVImpPlugin::setParsePolicy(QString policy)
+{
+  if (DEBUG) qDebug("CSVImpPlugin::setParsePolicy(%s)", qPrintable(policy));
+  _parsePolicy = CSVData::nameToParsePolicy(policy);
+  if (_csvtoolwindow)
+    _csvtoolwindow->setParsePolicy(_parsePolicy);
+}
+
+/* Have importCSV() continue after the last record an earlier import of the
+   same file with the same map committed, if it stopped part way.
+ */
+void CSVImpPlugin::setResume(bool resume)
+{
+  if (DEBUG) qDebug("CSVImpPlugin::setResume(%d)", resume);
+  _resume = resume;
+  if (_csvtoolwindow)
+    _csvtoolwindow->setResume(resume);
+}
+
 void CSVImpPlugin::cleanupDestroyedObject(QObject *object)
 {
   if (DEBUG)
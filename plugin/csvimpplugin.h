@@ -22,7 +22,7 @@ class CSVImpPlugin : public QObject, public CSVImpPluginInterface
   Q_OBJECT
   Q_INTERFACES(CSVImpPluginInterface)
 #if QT_VERSION >= 0x050000
-  Q_PLUGIN_METADATA(IID "org.xtuple.Plugin.CSVImpPluginInterface/0.4")
+  Q_PLUGIN_METADATA(IID "org.xtuple.Plugin.CSVImpPluginInterface/0.8")
 #endif
 
   public:
@@ -35,11 +35,15 @@ class CSVImpPlugin : public QObject, public CSVImpPluginInterface
     virtual QString lastError();
     virtual bool    openAtlas(QString filename = QString(), bool useDb = false);
     virtual bool    openCSV(QString filename = QString());
+    virtual bool    openCSV(QIODevice *device, QString name = QString());
     virtual void    setAtlasDir(QString dirname);
     virtual bool    setAtlasMap(const QString mapname);
     virtual void    setCSVDir(QString dirname);
+    virtual void    setCommitInterval(int rows, int seconds = 0);
     virtual bool    setFirstLineHeader(bool isheader);
     virtual void    setInteractive(bool isinteractive);
+    virtual void    setParsePolicy(QString policy);
+    virtual void    setResume(bool resume);
 
   protected slots:
     virtual void cleanupDestroyedObject(QObject *object);
@@ -47,10 +51,14 @@ class CSVImpPlugin : public QObject, public CSVImpPluginInterface
   protected:
     QString         _atlasdir;
     CSVAtlasWindow *_atlaswindow;
+    int             _commitRows;
+    int             _commitSeconds;
     QString         _csvdir;
     CSVToolWindow  *_csvtoolwindow;
     bool            _firstLineIsHeader;
     YAbstractMessageHandler *_msghandler;
+    CSVData::ParsePolicy     _parsePolicy;
+    bool            _resume;
 };
 
 #endif
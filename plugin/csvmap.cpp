@@ -21,6 +21,11 @@ CSVMap::CSVMap(const QString & name)
   _name = name;
   _description = QString {};
   _action = Insert;
+  _method = Statement;
+  _batchSize = 0;
+  _commitRows = 0;
+  _commitSeconds = 0;
+  _connections = 1;
   _sqlPre = QString {};
   _sqlPreContinueOnError = false;
   _sqlPost = QString {};
@@ -32,6 +37,11 @@ CSVMap::CSVMap(const QDomElement & elem)
   _description = QString {};
   _delimiter   = QString {};
   _action = Insert;
+  _method = Statement;
+  _batchSize = 0;
+  _commitRows = 0;
+  _commitSeconds = 0;
+  _connections = 1;
   _sqlPre = QString {};
   _sqlPreContinueOnError = false;
   _sqlPost = QString {};
@@ -46,10 +56,35 @@ CSVMap::CSVMap(const QDomElement & elem)
       setTable(elemThis.text());
     else if(elemThis.tagName() == "Action")
       setAction(nameToAction(elemThis.text()));
+    else if(elemThis.tagName() == "Method")
+      setMethod(nameToMethod(elemThis.text()));
+    else if(elemThis.tagName() == "BatchSize")
+      setBatchSize(elemThis.text().toInt());
+    else if(elemThis.tagName() == "Connections")
+      setConnections(elemThis.text().toInt());
+    else if(elemThis.tagName() == "Commit")
+      setCommitInterval(elemThis.attribute("rows").toInt(),
+                        elemThis.attribute("seconds").toInt());
     else if(elemThis.tagName() == "Description")
       setDescription(elemThis.text());
     else if (elemThis.tagName() == "Delimiter")
       setDelimiter(elemThis.text());
+    else if (elemThis.tagName() == "FixedWidth")
+    {
+      QDomNodeList cList = elemThis.elementsByTagName("Column");
+      for (int c = 0; c < cList.count(); ++c)
+      {
+        QDomElement col = cList.item(c).toElement();
+        _fixedWidth.append(qMakePair(col.attribute("start").toInt(),
+                                     col.attribute("length").toInt()));
+      }
+    }
+    else if (elemThis.tagName() == "JsonColumns")
+    {
+      QDomNodeList cList = elemThis.elementsByTagName("Column");
+      for (int c = 0; c < cList.count(); ++c)
+        _jsonColumns.append(cList.item(c).toElement().text());
+    }
     else if(elemThis.tagName() == "PreSQL")
     {
       setSqlPre(elemThis.text());
@@ -92,6 +127,37 @@ QDomElement CSVMap::createElement(QDomDocument & doc)
   elemThis.appendChild(doc.createTextNode(actionToName(_action)));
   elem.appendChild(elemThis);
 
+  if (_method != Statement)
+  {
+    elemThis = doc.createElement("Method");
+    elemThis.appendChild(doc.createTextNode(methodToName(_method)));
+    elem.appendChild(elemThis);
+  }
+
+  if (_batchSize > 0)
+  {
+    elemThis = doc.createElement("BatchSize");
+    elemThis.appendChild(doc.createTextNode(QString::number(_batchSize)));
+    elem.appendChild(elemThis);
+  }
+
+  if (_connections > 1)
+  {
+    elemThis = doc.createElement("Connections");
+    elemThis.appendChild(doc.createTextNode(QString::number(_connections)));
+    elem.appendChild(elemThis);
+  }
+
+  if (_commitRows > 0 || _commitSeconds > 0)
+  {
+    elemThis = doc.createElement("Commit");
+    if (_commitRows > 0)
+      elemThis.setAttribute("rows", _commitRows);
+    if (_commitSeconds > 0)
+      elemThis.setAttribute("seconds", _commitSeconds);
+    elem.appendChild(elemThis);
+  }
+
   if(!_description.isEmpty())
   {
     elemThis = doc.createElement("Description");
@@ -106,6 +172,31 @@ QDomElement CSVMap::createElement(QDomDocument & doc)
     elem.appendChild(elemThis);
   }
 
+  if (!_fixedWidth.isEmpty())
+  {
+    elemThis = doc.createElement("FixedWidth");
+    for (int c = 0; c < _fixedWidth.size(); ++c)
+    {
+      QDomElement col = doc.createElement("Column");
+      col.setAttribute("start",  _fixedWidth.at(c).first);
+      col.setAttribute("length", _fixedWidth.at(c).second);
+      elemThis.appendChild(col);
+    }
+    elem.appendChild(elemThis);
+  }
+
+  if (!_jsonColumns.isEmpty())
+  {
+    elemThis = doc.createElement("JsonColumns");
+    for (int c = 0; c < _jsonColumns.size(); ++c)
+    {
+      QDomElement col = doc.createElement("Column");
+      col.appendChild(doc.createTextNode(_jsonColumns.at(c)));
+      elemThis.appendChild(col);
+    }
+    elem.appendChild(elemThis);
+  }
+
   if(!_sqlPre.isEmpty())
   {
     elemThis = doc.createElement("PreSQL");
@@ -147,6 +238,16 @@ void CSVMap::setDelimiter(const QString & delim)
   _delimiter = delim;
 }
 
+void CSVMap::setFixedWidthLayout(const QList<QPair<int, int> > &layout)
+{
+  _fixedWidth = layout;
+}
+
+void CSVMap::setJsonColumns(const QStringList &columns)
+{
+  _jsonColumns = columns;
+}
+
 void CSVMap::setDescription(const QString & desc)
 {
   _description = desc;
@@ -157,6 +258,27 @@ void CSVMap::setAction(Action act)
   _action = act;
 }
 
+void CSVMap::setMethod(Method method)
+{
+  _method = method;
+}
+
+void CSVMap::setBatchSize(int size)
+{
+  _batchSize = qMax(size, 0);
+}
+
+void CSVMap::setConnections(int connections)
+{
+  _connections = qMax(connections, 1);
+}
+
+void CSVMap::setCommitInterval(int rows, int seconds)
+{
+  _commitRows    = qMax(rows, 0);
+  _commitSeconds = qMax(seconds, 0);
+}
+
 void CSVMap::setField(const CSVMapField & f)
 {
   for(int i = 0; i < _fields.count(); ++i)
@@ -242,6 +364,8 @@ QString CSVMap::actionToName(Action act)
     str = "Update";
   else if(act == Append)
     str = "Append";
+  else if(act == Upsert)
+    str = "Upsert";
   return str;
 }
 
@@ -253,9 +377,48 @@ CSVMap::Action CSVMap::nameToAction(const QString & name)
     return Update;
   else if("Append" == name)
     return Append;
+  else if("Upsert" == name)
+    return Upsert;
   return Insert;
 }
 
+QString CSVMap::methodToName(Method method)
+{
+  QString str = "Unknown";
+  if(method == Statement)
+    str = "Statement";
+  else if(method == Values)
+    str = "Values";
+  else if(method == Copy)
+    str = "Copy";
+  else if(method == BinaryCopy)
+    str = "BinaryCopy";
+  else if(method == Staging)
+    str = "Staging";
+  else if(method == Pipeline)
+    str = "Pipeline";
+  else if(method == Array)
+    str = "Array";
+  return str;
+}
+
+CSVMap::Method CSVMap::nameToMethod(const QString & name)
+{
+  if("Values" == name)
+    return Values;
+  else if("Copy" == name)
+    return Copy;
+  else if("BinaryCopy" == name)
+    return BinaryCopy;
+  else if("Staging" == name)
+    return Staging;
+  else if("Pipeline" == name)
+    return Pipeline;
+  else if("Array" == name)
+    return Array;
+  return Statement;
+}
+
 //
 // CSVMapField
 //
@@ -270,6 +433,7 @@ CSVMapField::CSVMapField(const QString & name)
   _columnAlt = 1;
   _ifNullActionAlt = Nothing;
   _valueAlt = QString {};
+  _fileType = TYPE_NA;
 }
 
 CSVMapField::CSVMapField(const QDomElement & elem)
@@ -283,6 +447,7 @@ CSVMapField::CSVMapField(const QDomElement & elem)
   _columnAlt = 1;
   _ifNullActionAlt = Nothing;
   _valueAlt = QString {};
+  _fileType = TYPE_NA;
 
   Action action = Action_Default;
 
@@ -14,6 +14,7 @@
 #include <QDomDocument>
 #include <QDomElement>
 #include <QList>
+#include <QPair>
 #include <QSqlField>
 #include <QString>
 #include <QStringList>
@@ -122,9 +123,32 @@ class CSVMap
     QString description() const { return _description; }
     void setDelimiter(const QString &delim);
     QString delimiter()   const { return _delimiter; }
-    enum Action { Insert, Update, Append };
+    // 1-based start and length of each data column in a fixed-width file;
+    // empty for delimited files
+    void setFixedWidthLayout(const QList<QPair<int, int> > &layout);
+    QList<QPair<int, int> > fixedWidthLayout() const { return _fixedWidth; }
+    // top-level keys or JSON pointers giving each data column of a JSON
+    // Lines file, in column order
+    void setJsonColumns(const QStringList &columns);
+    QStringList jsonColumns() const { return _jsonColumns; }
+    enum Action { Insert, Update, Append, Upsert };
     void setAction(Action);
     Action action() const { return _action; }
+    // how rows are sent to the database and how many are sent at once;
+    // a batch size of 0 lets the method pick
+    enum Method { Statement, Values, Copy, BinaryCopy, Staging, Pipeline, Array };
+    void setMethod(Method);
+    Method method() const { return _method; }
+    void setBatchSize(int);
+    int batchSize() const { return _batchSize; }
+    // import in transactions committed every so many rows or seconds;
+    // 0 for both imports without a transaction
+    void setCommitInterval(int rows, int seconds = 0);
+    // number of database connections writing in parallel
+    void setConnections(int);
+    int connections() const { return _connections; }
+    int commitRows()    const { return _commitRows; }
+    int commitSeconds() const { return _commitSeconds; }
 
     void setField(const CSVMapField &);
     bool removeField(const QString &);
@@ -147,6 +171,8 @@ class CSVMap
 
     static QString actionToName(Action);
     static Action nameToAction(const QString &);
+    static QString methodToName(Method);
+    static Method nameToMethod(const QString &);
 
   protected:
     QList<CSVMapField> _fields;
@@ -158,8 +184,15 @@ class CSVMap
     QString _name;
     QString _table;
     Action  _action;
+    Method  _method;
+    int     _batchSize;
+    int     _commitRows;
+    int     _commitSeconds;
+    int     _connections;
     QString _description;
     QString _delimiter;
+    QList<QPair<int, int> > _fixedWidth;
+    QStringList _jsonColumns;
 };
 
 #endif
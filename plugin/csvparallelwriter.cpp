@@ -0,0 +1,409 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvparallelwriter.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+#include <QWaitCondition>
+
+#define DEBUG false
+
+/* One worker: a thread owning a connection cloned from the import's, and
+   the plan and writer using it. Chunks of rows arrive on a bounded queue.
+ */
+class CSVWriterThread : public QThread
+{
+  public:
+    CSVWriterThread(const CSVMap &map, const QSqlDatabase &db, int id);
+
+    bool committed();
+    void enqueue(const QList<CSVImportRow> &rows);
+    void finish(bool commit);
+    void flush();
+    void setCommitInterval(int rows, int seconds);
+    void take(int &written, int &ignored, int &skipped, int &failed,
+              int &lastCommitted, QList<CSVImportError> &errors);
+
+  protected:
+    virtual void run();
+    void         record(CSVImportWriter *writer);
+
+    enum Request { None, Flush, Commit, Rollback };
+
+    int            _commitRows;
+    int            _commitSeconds;
+    QString        _connection;
+    QString        _connectOptions;
+    QString        _databaseName;
+    QString        _driverName;
+    QString        _hostName;
+    QString        _password;
+    int            _port;
+    QString        _userName;
+    CSVMap         _map;
+
+    QMutex         _mutex;          // guards everything below
+    QWaitCondition _changed;
+    bool           _busy;
+    bool           _committed;      // the last commit went through
+    QList<CSVImportError> _errors;
+    int            _failed;
+    int            _ignored;
+    int            _lastCommitted;
+    int            _lost;           // rows failed for want of a connection
+    QQueue<QList<CSVImportRow> > _queue;
+    Request        _request;
+    int            _skipped;
+    int            _written;
+};
+
+CSVWriterThread::CSVWriterThread(const CSVMap &map, const QSqlDatabase &db, int id)
+  : _commitRows(0),
+    _commitSeconds(0),
+    _connection(QString("csvimp_worker_%1").arg(id)),
+    _connectOptions(db.connectOptions()),
+    _databaseName(db.databaseName()),
+    _driverName(db.driverName()),
+    _hostName(db.hostName()),
+    _password(db.password()),
+    _port(db.port()),
+    _userName(db.userName()),
+    _map(map),
+    _busy(false),
+    _committed(true),
+    _failed(0),
+    _ignored(0),
+    _lastCommitted(-1),
+    _lost(0),
+    _request(None),
+    _skipped(0),
+    _written(0)
+{
+}
+
+bool CSVWriterThread::committed()
+{
+  QMutexLocker lock(&_mutex);
+  return _committed;
+}
+
+void CSVWriterThread::enqueue(const QList<CSVImportRow> &rows)
+{
+  QMutexLocker lock(&_mutex);
+  while (_queue.size() >= CSVParallelWriter::QueueDepth)
+    _changed.wait(&_mutex);
+  _queue.enqueue(rows);
+  _changed.wakeAll();
+}
+
+// stop once the queue is empty, committing or rolling back the last rows
+void CSVWriterThread::finish(bool commit)
+{
+  {
+    QMutexLocker lock(&_mutex);
+    _request = commit ? Commit : Rollback;
+    _changed.wakeAll();
+  }
+  if (isRunning())
+    wait();
+}
+
+// wait until every queued row has been sent to the database
+void CSVWriterThread::flush()
+{
+  QMutexLocker lock(&_mutex);
+  if (! isRunning())
+    return;
+  _request = Flush;
+  _changed.wakeAll();
+  while (_request == Flush || _busy || ! _queue.isEmpty())
+    _changed.wait(&_mutex);
+}
+
+void CSVWriterThread::setCommitInterval(int rows, int seconds)
+{
+  _commitRows    = rows;
+  _commitSeconds = seconds;
+}
+
+// add this worker's totals to the counts and move its errors to errors
+void CSVWriterThread::take(int &written, int &ignored, int &skipped, int &failed,
+                           int &lastCommitted, QList<CSVImportError> &errors)
+{
+  QMutexLocker lock(&_mutex);
+  written  += _written;
+  ignored  += _ignored;
+  skipped  += _skipped;
+  failed   += _failed;
+  errors   += _errors;
+  _errors.clear();
+  lastCommitted = _lastCommitted;
+}
+
+// called with _mutex held
+void CSVWriterThread::record(CSVImportWriter *writer)
+{
+  _written       = writer->written();
+  _ignored       = writer->ignored();
+  _skipped       = writer->skipped();
+  _failed        = writer->failed() + _lost;
+  _errors       += writer->takeErrors();
+  _lastCommitted = writer->lastCommittedRow();
+}
+
+void CSVWriterThread::run()
+{
+  {
+    QSqlDatabase db = QSqlDatabase::addDatabase(_driverName, _connection);
+    db.setDatabaseName(_databaseName);
+    db.setHostName(_hostName);
+    db.setPort(_port);
+    db.setUserName(_userName);
+    db.setPassword(_password);
+    db.setConnectOptions(_connectOptions);
+    bool open = db.open();
+
+    CSVImportPlan    plan(_map, db);
+    CSVImportWriter *writer = CSVImportWriter::create(&plan, _map);
+    writer->setCommitInterval(_commitRows, _commitSeconds);
+    bool transactional = _commitRows > 0 || _commitSeconds > 0;
+    if (open && transactional)
+      QSqlQuery(db).exec("BEGIN;");
+
+    QMutexLocker lock(&_mutex);
+    if (! open)
+      _errors.append(CSVImportError(CSVImportError::Message, -1,
+                                    QString("ERROR Could not open connection %1: %2")
+                                      .arg(_connection, db.lastError().text())));
+    while (true)
+    {
+      while (_queue.isEmpty() && _request == None)
+        _changed.wait(&_mutex);
+
+      if (! _queue.isEmpty())
+      {
+        QList<CSVImportRow> rows = _queue.dequeue();
+        _busy = true;
+        _changed.wakeAll();
+        lock.unlock();
+
+        if (open)
+          for (int r = 0; r < rows.size(); r++)
+            writer->add(rows.at(r));
+
+        lock.relock();
+        if (! open)
+        {
+          for (int r = 0; r < rows.size(); r++)
+            _errors.append(CSVImportError(CSVImportError::Failed, rows.at(r).row,
+                                          QString("ERROR Record %1: No connection")
+                                            .arg(rows.at(r).row + 1)));
+          _lost += rows.size();
+        }
+        _busy = false;
+        record(writer);
+        _changed.wakeAll();
+        continue;
+      }
+
+      Request request   = _request;
+      bool    committed = open;
+      lock.unlock();
+      if (open)
+      {
+        writer->flush();
+        if (request == Commit)
+          committed = writer->commit(false);
+        else if (request == Rollback && transactional)
+          QSqlQuery(db).exec("ROLLBACK;");
+      }
+      lock.relock();
+      if (request == Commit)
+        _committed = committed;
+      record(writer);
+      _request = None;
+      _changed.wakeAll();
+      if (request != Flush)
+        break;
+    }
+    lock.unlock();
+
+    delete writer;
+  }
+  QSqlDatabase::removeDatabase(_connection);
+
+  if (DEBUG)
+    qDebug("CSVWriterThread::run() %s done", qPrintable(_connection));
+}
+
+CSVParallelWriter::CSVParallelWriter(CSVImportPlan *plan, const CSVMap &map, int connections)
+  : CSVImportWriter(plan, ChunkRows),
+    _checkFailed(0),
+    _checkIgnored(0),
+    _next(0)
+{
+  for (int i = 0; i < qMax(connections, 1); i++)
+    _workers.append(new CSVWriterThread(map, plan->database(), i));
+  _buffers.resize(_workers.size());
+  _batches.fill(0, _workers.size());
+}
+
+CSVParallelWriter::~CSVParallelWriter()
+{
+  for (int i = 0; i < _workers.size(); i++)
+  {
+    _workers.at(i)->finish(false);
+    delete _workers.at(i);
+  }
+}
+
+bool CSVParallelWriter::add(const CSVImportRow &row)
+{
+  QString errmsg;
+  switch (_plan->check(row, &errmsg))
+  {
+    case CSVImportPlan::Ignored:
+      _checkIgnored++;
+      _errors.append(CSVImportError(CSVImportError::Ignored, row.row, errmsg));
+      return true;
+    case CSVImportPlan::Failed:
+      _checkFailed++;
+      _errors.append(CSVImportError(CSVImportError::Failed, row.row, errmsg));
+      return false;
+    default:
+      break;
+  }
+
+  int worker = route(row);
+  _buffers[worker].append(row);
+  if (_buffers.at(worker).size() >= _batchSize)
+    send(worker);
+
+  return true;
+}
+
+bool CSVParallelWriter::commit(bool reopen)
+{
+  Q_UNUSED(reopen);
+  for (int w = 0; w < _workers.size(); w++)
+    send(w);
+  bool committed = true;
+  for (int w = 0; w < _workers.size(); w++)
+  {
+    if (DEBUG)
+      qDebug("CSVParallelWriter::commit() worker %d got %d batches",
+             w, _batches.at(w));
+    _workers.at(w)->finish(true);
+    if (! _workers.at(w)->committed())
+      committed = false;
+  }
+
+  int failed = _failed;
+  collect();
+  // the pre- and post-import SQL ran in this connection's transaction
+  return CSVImportWriter::commit(false) && committed && _failed == failed;
+}
+
+bool CSVParallelWriter::flush()
+{
+  for (int w = 0; w < _workers.size(); w++)
+    send(w);
+  for (int w = 0; w < _workers.size(); w++)
+    _workers.at(w)->flush();
+
+  int failed = _failed;
+  collect();
+  return _failed == failed;
+}
+
+void CSVParallelWriter::rollback()
+{
+  for (int w = 0; w < _workers.size(); w++)
+  {
+    _buffers[w].clear();
+    _workers.at(w)->finish(false);
+  }
+  collect();
+}
+
+void CSVParallelWriter::setCommitInterval(int rows, int seconds)
+{
+  CSVImportWriter::setCommitInterval(rows, seconds);
+  for (int w = 0; w < _workers.size(); w++)
+    _workers.at(w)->setCommitInterval(_commitRows, _commitSeconds);
+}
+
+/* Gather the workers' counts and errors. Every row up to the lowest row
+   the workers have committed is known to be committed.
+ */
+void CSVParallelWriter::collect()
+{
+  _written = 0;
+  _ignored = _checkIgnored;
+  _skipped = 0;
+  _failed  = _checkFailed;
+
+  int  lastCommitted = -1;
+  bool first         = true;
+  for (int w = 0; w < _workers.size(); w++)
+  {
+    int workerCommitted = -1;
+    _workers.at(w)->take(_written, _ignored, _skipped, _failed,
+                         workerCommitted, _errors);
+    if (! _workers.at(w)->isRunning() && ! _workers.at(w)->isFinished())
+      continue;   // never got any rows
+    if (first || workerCommitted < lastCommitted)
+      lastCommitted = workerCommitted;
+    first = false;
+  }
+  _lastCommitted = lastCommitted;
+}
+
+int CSVParallelWriter::route(const CSVImportRow &row)
+{
+  if (_plan->action() == CSVMap::Insert)
+    return _next;
+
+  uint hash = 0;
+  for (int c = 0; c < _plan->columnCount(); c++)
+    if (_plan->isKey(c) && ! row.omitted.testBit(c))
+      hash = hash * 31 + qHash(row.values.at(c).toString());
+
+  return hash % _workers.size();
+}
+
+void CSVParallelWriter::send(int worker)
+{
+  if (_buffers.at(worker).isEmpty())
+    return;
+
+  CSVWriterThread *thread = _workers.at(worker);
+  if (! thread->isRunning() && ! thread->isFinished())
+    thread->start();
+  thread->enqueue(_buffers.at(worker));
+  _buffers[worker].clear();
+  _batches[worker]++;
+
+  /* deal the next Insert batch to the next worker; dealt in turn, the
+     workers up to this one have all had the same number of batches
+   */
+  if (_plan->action() == CSVMap::Insert)
+  {
+    Q_ASSERT(worker == _next && _batches.at(0) == _batches.at(worker));
+    _next = (worker + 1) % _workers.size();
+  }
+  collect();    // keep the workers' errors from piling up
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVPARALLELWRITER_H__
+#define __CSVPARALLELWRITER_H__
+
+#include <QVector>
+
+#include "csvimportwriter.h"
+
+class CSVWriterThread;
+
+/* Spreads rows over a pool of worker threads, each with its own database
+   connection, CSVImportPlan, writer and transaction. Insert rows are dealt
+   out round-robin; rows of the other actions go to a worker chosen by the
+   hash of their keys, so no two workers touch the same record.
+ */
+class CSVParallelWriter : public CSVImportWriter
+{
+  public:
+    static const int ChunkRows  = 1000;   // rows handed to a worker at once
+    static const int QueueDepth = 4;      // chunks waiting per worker
+
+    CSVParallelWriter(CSVImportPlan *plan, const CSVMap &map, int connections);
+    virtual ~CSVParallelWriter();
+
+    virtual bool add(const CSVImportRow &row);
+    virtual bool commit(bool reopen = true);
+    virtual bool flush();
+    virtual void rollback();
+    virtual void setCommitInterval(int rows, int seconds = 0);
+
+  protected:
+    void collect();
+    int  route(const CSVImportRow &row);
+    void send(int worker);
+
+    QVector<int>                  _batches;       // sent to each worker
+    QVector<QList<CSVImportRow> > _buffers;
+    int                           _checkFailed;   // rows check() turned away
+    int                           _checkIgnored;
+    int                           _next;
+    QList<CSVWriterThread*>       _workers;
+};
+
+#endif
@@ -0,0 +1,294 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvpipelinewriter.h"
+
+#include <QAtomicInt>
+#include <QtGlobal>
+
+#ifdef Q_OS_WIN
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
+
+#include <libpq-fe.h>
+
+#include "csvcopywriter.h"
+
+#define DEBUG false
+
+// numbers the writers so their statement names never collide on a connection
+static QAtomicInt writerCount;
+
+CSVPipelineWriter::CSVPipelineWriter(CSVImportPlan *plan, int batchSize)
+  : CSVImportWriter(plan, batchSize > 0 ? batchSize : int(DefaultBatchSize)),
+    _conn(CSVCopyWriter::connection(plan->database())),
+    _id(writerCount.fetchAndAddRelaxed(1))
+{
+}
+
+/* Prepared statements outlive the writer on the connection otherwise.
+   DEALLOCATE fails inside an aborted transaction; the statements left
+   behind then only cost memory on the server because no later writer
+   reuses their names.
+ */
+CSVPipelineWriter::~CSVPipelineWriter()
+{
+  if (! _conn || PQtransactionStatus(_conn) == PQTRANS_INERROR)
+    return;
+
+  QHash<QBitArray, CSVPipelineStatement>::iterator it;
+  for (it = _statements.begin(); it != _statements.end(); ++it)
+    PQclear(PQexec(_conn, ("DEALLOCATE " + it.value().name).constData()));
+}
+
+// the server dropped the prepared statements with the old connection
+void CSVPipelineWriter::reconnected()
+{
+  CSVImportWriter::reconnected();
+  _conn = CSVCopyWriter::connection(_plan->database());
+  _statements.clear();
+}
+
+/* A row that fails undoes the rows before it in the same pipeline, and the
+   rows after it are never run. So report the failing row, drop it and send
+   the rest of its window again until the window goes through cleanly; the
+   batch is sent a window at a time so a failure costs at most a window.
+   If a window cannot be sent at all, the windows before it stay written
+   without a transaction and _done tells flush() to skip them.
+ */
+bool CSVPipelineWriter::writeBatch(const QList<CSVImportRow> &rows, QString *errmsg)
+{
+#ifdef LIBPQ_HAS_PIPELINING
+  if (! _conn)
+  {
+    if (errmsg)
+      *errmsg = QString("Pipelining needs a PostgreSQL connection");
+    return false;
+  }
+
+  CSVPipelineStatement *stmt = statement(rows.first().omitted, errmsg);
+  if (! stmt)
+    return false;
+
+  int written = _written;
+  int failed  = _failed;
+  int errors  = _errors.size();
+  for (int first = 0; first < rows.size(); first += WindowRows)
+  {
+    QList<CSVImportRow> pending = rows.mid(first, WindowRows);
+    while (! pending.isEmpty())
+    {
+      int     failedAt = -1;
+      QString error;
+      QString code;
+      if (! send(stmt, pending, &failedAt, &error, &code))
+      {
+        if (errmsg)
+          *errmsg = error;
+        if (isTransactional())
+        {
+          _written = written;
+          _failed  = failed;
+          _errors  = _errors.mid(0, errors);
+        }
+        else
+          _done = first;
+        return false;
+      }
+
+      if (failedAt < 0)
+      {
+        _written += pending.size();
+        break;
+      }
+
+      fail(pending.at(failedAt).row,
+           QString("ERROR Record %1: %2").arg(pending.at(failedAt).row + 1).arg(error),
+           code);
+      pending.removeAt(failedAt);
+    }
+  }
+
+  return true;
+#else
+  return CSVImportWriter::writeBatch(rows, errmsg);
+#endif
+}
+
+CSVPipelineStatement *CSVPipelineWriter::statement(const QBitArray &omitted, QString *errmsg)
+{
+  QHash<QBitArray, CSVPipelineStatement>::iterator it = _statements.find(omitted);
+  if (it != _statements.end())
+    return &it.value();
+
+  CSVPipelineStatement stmt;
+  QString sql = _plan->statementText(omitted, stmt.binds, true);
+  stmt.name   = QString("csvimp_pipeline_%1_%2")
+                  .arg(_id).arg(_statements.size()).toUtf8();
+
+  if (DEBUG)
+    qDebug("CSVPipelineWriter::statement() preparing %s", qPrintable(sql));
+
+  PGresult *res = PQprepare(_conn, stmt.name.constData(), sql.toUtf8().constData(),
+                            stmt.binds.size(), 0);
+  bool prepared = PQresultStatus(res) == PGRES_COMMAND_OK;
+  if (! prepared && errmsg)
+    *errmsg = QString("ERROR Preparing %1: %2")
+                .arg(sql, QString::fromUtf8(PQresultErrorMessage(res)));
+  PQclear(res);
+  if (! prepared)
+    return 0;
+
+  return &_statements.insert(omitted, stmt).value();
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+/* Send what libpq has queued, reading input meanwhile so the server is
+   never stuck writing results nobody reads while it still has rows to
+   receive. Waits on the socket rather than spinning.
+ */
+static bool flushPipeline(PGconn *conn)
+{
+  int result;
+  while ((result = PQflush(conn)) == 1)
+  {
+    int    sock = PQsocket(conn);
+    fd_set readable;
+    fd_set writable;
+    FD_ZERO(&readable);
+    FD_ZERO(&writable);
+    FD_SET(sock, &readable);
+    FD_SET(sock, &writable);
+    if (select(sock + 1, &readable, &writable, 0, 0) < 0)
+      return false;
+    if (FD_ISSET(sock, &readable) && PQconsumeInput(conn) != 1)
+      return false;
+  }
+
+  return result == 0;
+}
+#endif
+
+/* Send rows in one pipeline and read back their results. failedAt gets the
+   index of the row that failed, with its error in errmsg and its SQLSTATE
+   in code, or -1 if all rows were written. Returns false if the pipeline
+   itself could not be run.
+
+   Outside a transaction the pipeline is one implicit transaction. Inside
+   one a failure aborts the caller's transaction, so the pipeline sets a
+   savepoint first and rolls back to it.
+ */
+bool CSVPipelineWriter::send(CSVPipelineStatement *stmt, const QList<CSVImportRow> &rows,
+                             int *failedAt, QString *errmsg, QString *code)
+{
+#ifdef LIBPQ_HAS_PIPELINING
+  *failedAt = -1;
+  if (PQsetnonblocking(_conn, 1) != 0 || PQenterPipelineMode(_conn) != 1)
+  {
+    *errmsg = QString::fromUtf8(PQerrorMessage(_conn));
+    PQsetnonblocking(_conn, 0);
+    return false;
+  }
+
+  int  params    = stmt->binds.size();
+  bool savepoint = isTransactional();
+  int  commands  = 0;
+  bool sent      = ! savepoint ||
+                   PQsendQueryParams(_conn, "SAVEPOINT csvimp_pipeline;",
+                                     0, 0, 0, 0, 0, 0) == 1;
+  if (savepoint && sent)
+    commands++;
+
+  QVector<QByteArray>   data(params);
+  QVector<const char *> values(params);
+  int rowsSent = 0;
+  for (; rowsSent < rows.size() && sent; rowsSent++)
+  {
+    const CSVImportRow &row = rows.at(rowsSent);
+    for (int b = 0; b < params; b++)
+    {
+      const QVariant &value = row.values.at(stmt->binds.at(b));
+      if (value.isNull())
+      {
+        values[b] = 0;
+        continue;
+      }
+      if (value.type() == QVariant::ByteArray)
+        data[b] = "\\x" + value.toByteArray().toHex();
+      else
+        data[b] = value.toString().toUtf8();
+      values[b] = data.at(b).constData();
+    }
+    sent = PQsendQueryPrepared(_conn, stmt->name.constData(), params,
+                               values.constData(), 0, 0, 0) == 1;
+    if (sent)
+      commands++;
+    if (sent && commands % FlushRows == 0)
+      sent = flushPipeline(_conn);
+  }
+  if (! sent)
+    *errmsg = QString::fromUtf8(PQerrorMessage(_conn));
+
+  bool synced = PQpipelineSync(_conn) == 1 && flushPipeline(_conn);
+  PQsetnonblocking(_conn, 0);
+  bool failed = ! sent;
+  for (int c = 0; c < commands; c++)
+  {
+    PGresult *res;
+    while ((res = PQgetResult(_conn)) != 0)
+    {
+      if (PQresultStatus(res) == PGRES_FATAL_ERROR && ! failed)
+      {
+        // the savepoint itself failing is not a row's fault
+        if (savepoint && c == 0)
+          sent = false;
+        else
+          *failedAt = c - (savepoint ? 1 : 0);
+        *errmsg = QString::fromUtf8(PQresultErrorMessage(res)).trimmed();
+        *code   = QString::fromLatin1(PQresultErrorField(res, PG_DIAG_SQLSTATE));
+        failed  = true;
+      }
+      PQclear(res);
+    }
+  }
+
+  if (synced)
+  {
+    PGresult *res = PQgetResult(_conn);
+    synced = PQresultStatus(res) == PGRES_PIPELINE_SYNC;
+    PQclear(res);
+  }
+  if (! synced && ! failed)
+    *errmsg = QString::fromUtf8(PQerrorMessage(_conn));
+  PQexitPipelineMode(_conn);
+
+  if (savepoint)
+  {
+    if (failed || ! synced)
+      PQclear(PQexec(_conn, "ROLLBACK TO SAVEPOINT csvimp_pipeline;"));
+    PQclear(PQexec(_conn, "RELEASE SAVEPOINT csvimp_pipeline;"));
+  }
+
+  if (DEBUG)
+    qDebug("CSVPipelineWriter::send() %d of %d rows sent, failed at %d",
+           rowsSent, rows.size(), *failedAt);
+
+  return sent && synced;
+#else
+  Q_UNUSED(stmt);
+  Q_UNUSED(rows);
+  Q_UNUSED(failedAt);
+  Q_UNUSED(errmsg);
+  Q_UNUSED(code);
+  return false;
+#endif
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVPIPELINEWRITER_H__
+#define __CSVPIPELINEWRITER_H__
+
+#include <QByteArray>
+#include <QHash>
+
+#include "csvimportwriter.h"
+
+typedef struct pg_conn PGconn;
+
+class CSVPipelineStatement
+{
+  public:
+    QByteArray   name;
+    QVector<int> binds;         // plan column for each $n parameter
+};
+
+/* Runs the plan's per-row statements, so triggers and rules still see one
+   statement per row, but sends them with libpq's pipeline mode, up to
+   WindowRows executions before reading any result. Results come back in
+   order and are matched to their rows for error reporting. While sending,
+   the connection is non-blocking and incoming results are read as they
+   arrive, so neither side stalls on a full socket buffer. Built against a
+   libpq without pipeline mode it writes one row at a time.
+ */
+class CSVPipelineWriter : public CSVImportWriter
+{
+  public:
+    static const int DefaultBatchSize = 1000;
+    static const int FlushRows        = 64;   // rows queued between flushes
+    static const int WindowRows       = 500;  // rows per pipeline sync
+
+    CSVPipelineWriter(CSVImportPlan *plan, int batchSize = 0);
+    virtual ~CSVPipelineWriter();
+
+  protected:
+    virtual bool writeBatch(const QList<CSVImportRow> &rows, QString *errmsg);
+    virtual void reconnected();
+    CSVPipelineStatement *statement(const QBitArray &omitted, QString *errmsg);
+    bool send(CSVPipelineStatement *stmt, const QList<CSVImportRow> &rows,
+              int *failedAt, QString *errmsg, QString *code);
+
+    PGconn *_conn;
+    int     _id;
+    QHash<QBitArray, CSVPipelineStatement> _statements;
+};
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvrejectwriter.h"
+
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#define DEBUG false
+
+CSVRejectWriter::CSVRejectWriter(const QString &filename, QChar delimiter,
+                                 bool append)
+  : _append(append),
+    _appending(append && QFileInfo(filename).size() > 0),
+    _delimiter(delimiter),
+    _file(filename),
+    _records(0),
+    _closing(false)
+{
+}
+
+CSVRejectWriter::~CSVRejectWriter()
+{
+  close();
+}
+
+// write whatever is still buffered and close the file
+bool CSVRejectWriter::close()
+{
+  {
+    QMutexLocker lock(&_mutex);
+    _closing = true;
+    _changed.wakeAll();
+  }
+  if (isRunning())
+    wait();
+
+  return errorString().isEmpty();
+}
+
+QString CSVRejectWriter::errorString() const
+{
+  QMutexLocker lock(&_mutex);
+  return _error;
+}
+
+// columns given by 1-based start and width, as CSVData reads them
+void CSVRejectWriter::setFixedWidthLayout(const QList<QPair<int, int> > &layout)
+{
+  _fixedWidth = layout;
+}
+
+// queue one record; false once the file cannot be written
+bool CSVRejectWriter::write(const QStringList &fields)
+{
+  QByteArray line;
+  if (! _fixedWidth.isEmpty())
+    line = fixedWidth(fields);
+  else
+  {
+    for (int i = 0; i < fields.size(); i++)
+    {
+      if (i > 0)
+        line.append(QString(_delimiter).toUtf8());
+      line.append(quote(fields.at(i)));
+    }
+  }
+  line.append('\n');
+
+  if (! isRunning() && ! isFinished())
+  {
+    if (! _file.open(QIODevice::WriteOnly |
+                     (_append ? QIODevice::Append : QIODevice::Truncate)))
+    {
+      QMutexLocker lock(&_mutex);
+      _error = _file.errorString();
+      return false;
+    }
+    start();
+  }
+
+  QMutexLocker lock(&_mutex);
+  while (_buffer.size() >= BufferBytes && _error.isEmpty())
+    _changed.wait(&_mutex);
+  if (! _error.isEmpty() || _closing)
+    return false;
+
+  _buffer.append(line);
+  _records++;
+  _changed.wakeAll();
+
+  return true;
+}
+
+/* Place each field at its column, padded with spaces to the column's width,
+   and put the fields the layout has no column for after the last one.
+ */
+QByteArray CSVRejectWriter::fixedWidth(const QStringList &fields) const
+{
+  QByteArray line;
+  for (int i = 0; i < _fixedWidth.size() && i < fields.size(); i++)
+  {
+    int start = _fixedWidth.at(i).first - 1;
+    int width = _fixedWidth.at(i).second;
+    if (line.size() < start + width)
+      line.append(QByteArray(start + width - line.size(), ' '));
+    QByteArray value = fields.at(i).toUtf8().left(width);
+    line.replace(start, value.size(), value);
+  }
+
+  for (int i = _fixedWidth.size(); i < fields.size(); i++)
+  {
+    QString extra = fields.at(i);
+    extra.replace('\r', ' ').replace('\n', ' ');
+    line.append(' ').append(extra.toUtf8());
+  }
+
+  return line;
+}
+
+/* Quote fields the way the CSV reader expects them: in double quotes, with
+   quotes doubled, if they hold the delimiter, a quote, a line break or
+   surrounding space.
+ */
+QByteArray CSVRejectWriter::quote(const QString &field) const
+{
+  if (field.contains(_delimiter) || field.contains('"') ||
+      field.contains('\n') || field.contains('\r') ||
+      field.startsWith(' ') || field.endsWith(' '))
+  {
+    QString quoted = field;
+    quoted.replace("\"", "\"\"");
+    return "\"" + quoted.toUtf8() + "\"";
+  }
+
+  return field.toUtf8();
+}
+
+void CSVRejectWriter::run()
+{
+  QMutexLocker lock(&_mutex);
+  while (true)
+  {
+    while (_buffer.isEmpty() && ! _closing)
+      _changed.wait(&_mutex);
+    if (_buffer.isEmpty())
+      break;
+
+    QByteArray data;
+    data.swap(_buffer);
+    _changed.wakeAll();
+    lock.unlock();
+
+    bool written = _file.write(data) == data.size();
+
+    lock.relock();
+    if (! written)
+    {
+      _error = _file.errorString();
+      _buffer.clear();
+      _changed.wakeAll();
+      break;
+    }
+  }
+  lock.unlock();
+
+  _file.close();
+  if (DEBUG)
+    qDebug("CSVRejectWriter::run() wrote %d records to %s",
+           _records, qPrintable(_file.fileName()));
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVREJECTWRITER_H__
+#define __CSVREJECTWRITER_H__
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+
+/* Writes records to a CSV file on a thread of its own, so an import with
+   many failing rows neither waits on the disk nor keeps the rows in memory.
+   write() only blocks when more than BufferBytes are waiting. The file is
+   created with the first record, or with append, added to.
+   Given a fixed-width layout, records are written in that layout with any
+   fields past it, such as the error, after the last column, where the
+   fixed-width reader ignores them.
+ */
+class CSVRejectWriter : public QThread
+{
+  public:
+    static const int BufferBytes = 4 * 1024 * 1024;
+
+    CSVRejectWriter(const QString &filename, QChar delimiter = ',',
+                    bool append = false);
+    virtual ~CSVRejectWriter();
+
+    bool    appending()   const { return _appending; }
+    bool    close();
+    QString errorString() const;
+    QString fileName()    const { return _file.fileName(); }
+    int     records()     const { return _records; }
+    void    setFixedWidthLayout(const QList<QPair<int, int> > &layout);
+    bool    write(const QStringList &fields);
+
+  protected:
+    virtual void run();
+    QByteArray   fixedWidth(const QStringList &fields) const;
+    QByteArray   quote(const QString &field) const;
+
+    bool           _append;
+    bool           _appending;    // adding to records already in the file
+    QChar          _delimiter;
+    QFile          _file;
+    QList<QPair<int, int> > _fixedWidth;
+    int            _records;
+
+    mutable QMutex _mutex;          // guards everything below
+    QWaitCondition _changed;
+    QByteArray     _buffer;
+    bool           _closing;
+    QString        _error;
+};
+
+#endif
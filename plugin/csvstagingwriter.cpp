@@ -0,0 +1,238 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvstagingwriter.h"
+
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+
+#define DEBUG false
+
+const QString CSVStagingWriter::StagingTable("csvimp_stage");
+
+CSVStagingWriter::CSVStagingWriter(CSVImportPlan *plan, int batchSize)
+  : CSVCopyWriter(plan, batchSize),
+    _created(false)
+{
+}
+
+CSVStagingWriter::~CSVStagingWriter()
+{
+}
+
+bool CSVStagingWriter::writeBatch(const QList<CSVImportRow> &rows, QString *errmsg)
+{
+  if (_plan->action() == CSVMap::Insert)
+    return CSVCopyWriter::writeBatch(rows, errmsg);
+
+  if (! _conn)
+  {
+    if (errmsg)
+      *errmsg = QString("Staging needs a PostgreSQL connection");
+    return false;
+  }
+
+  // a failed batch may have rolled back the CREATE with its savepoint
+  if (! stage(rows, errmsg))
+  {
+    _created = false;
+    return false;
+  }
+
+  /* Find the rows that will not be applied before applying the batch, so
+     a failed query leaves nothing written: the repeated keys that
+     statement() drops, and for Update the rows with nothing to update.
+   */
+  const QBitArray &omitted = rows.first().omitted;
+  QList<int> duplicates;
+  QList<int> unmatched;
+  if (! rowNumbers(QString("SELECT csvimp_row FROM %1 s"
+                           " WHERE EXISTS (SELECT 1 FROM %1 d"
+                           "                WHERE %2 AND d.csvimp_row %3 s.csvimp_row)"
+                           " ORDER BY csvimp_row;")
+                     .arg(StagingTable, keyMatch(omitted, "d", "s", true),
+                          _plan->action() == CSVMap::Append ? "<" : ">"),
+                   duplicates, errmsg))
+  {
+    _created = false;
+    return false;
+  }
+
+  if (_plan->action() == CSVMap::Update &&
+      ! rowNumbers(QString("SELECT csvimp_row FROM %1 s"
+                           " WHERE NOT EXISTS (SELECT 1 FROM %2 t WHERE %3)"
+                           " ORDER BY csvimp_row;")
+                     .arg(StagingTable, _plan->table(),
+                          keyMatch(omitted, "t", "s")),
+                   unmatched, errmsg))
+  {
+    _created = false;
+    return false;
+  }
+
+  QSqlQuery qry(_plan->database());
+  if (! qry.exec(statement(omitted)))
+  {
+    if (errmsg)
+      *errmsg = qry.lastError().text();
+    _created = false;
+    return false;
+  }
+
+  for (int r = 0; r < duplicates.size(); r++)
+    ignore(duplicates.at(r),
+           QString("IGNORED Record %1: Another record in the same batch has the same key")
+             .arg(duplicates.at(r) + 1));
+
+  int unchanged = duplicates.size();
+  if (_plan->action() == CSVMap::Append)
+  {
+    int existing = rows.size() - duplicates.size() - qry.numRowsAffected();
+    _skipped  += existing;
+    unchanged += existing;
+  }
+  else if (_plan->action() == CSVMap::Update)
+  {
+    for (int r = 0; r < unmatched.size(); r++)
+    {
+      if (duplicates.contains(unmatched.at(r)))
+        continue;
+      ignore(unmatched.at(r),
+             QString("IGNORED Record %1: There is no record to update")
+               .arg(unmatched.at(r) + 1));
+      unchanged++;
+    }
+  }
+
+  if (DEBUG)
+    qDebug("CSVStagingWriter::writeBatch() %d rows staged, %d unchanged",
+           rows.size(), unchanged);
+
+  _written += rows.size() - unchanged;
+  return true;
+}
+
+// nullsEqual matches NULL keys to each other, as DISTINCT ON does
+QString CSVStagingWriter::keyMatch(const QBitArray &omitted, const QString &target,
+                                   const QString &staged, bool nullsEqual) const
+{
+  QStringList match;
+  for (int c = 0; c < _plan->columnCount(); c++)
+    if (_plan->isKey(c) && ! omitted.testBit(c))
+      match.append(QString("%1.%4 %3 %2.%4")
+                     .arg(target, staged,
+                          nullsEqual ? "IS NOT DISTINCT FROM" : "=",
+                          _plan->columnName(c)));
+  return match.join(" AND ");
+}
+
+// run a query returning csvimp_row values and collect them
+bool CSVStagingWriter::rowNumbers(const QString &sql, QList<int> &rows,
+                                  QString *errmsg) const
+{
+  QSqlQuery qry(_plan->database());
+  if (! qry.exec(sql))
+  {
+    if (errmsg)
+      *errmsg = qry.lastError().text();
+    return false;
+  }
+
+  while (qry.next())
+    rows.append(qry.value(0).toInt());
+  return true;
+}
+
+// the temporary staging table went away with the old connection
+void CSVStagingWriter::reconnected()
+{
+  CSVCopyWriter::reconnected();
+  _created = false;
+}
+
+/* Fill the staging table with rows. The table lives as long as the session,
+   so an earlier import with another map may have left one with different
+   columns; it is replaced for the first batch and emptied for the others.
+ */
+bool CSVStagingWriter::stage(const QList<CSVImportRow> &rows, QString *errmsg)
+{
+  QSqlQuery qry(_plan->database());
+  if (_created)
+  {
+    if (! qry.exec(QString("TRUNCATE %1;").arg(StagingTable)))
+    {
+      if (errmsg)
+        *errmsg = qry.lastError().text();
+      return false;
+    }
+  }
+  else
+  {
+    QStringList defs;
+    for (int c = 0; c < _plan->columnCount(); c++)
+      defs.append(_plan->columnName(c) + " " + _plan->columnType(c));
+
+    if (! qry.exec(QString("DROP TABLE IF EXISTS pg_temp.%1;").arg(StagingTable)) ||
+        ! qry.exec(QString("CREATE TEMPORARY TABLE %1 (csvimp_row integer, %2);")
+                     .arg(StagingTable, defs.join(", "))))
+    {
+      if (errmsg)
+        *errmsg = qry.lastError().text();
+      return false;
+    }
+    _created = true;
+  }
+
+  return copyText(StagingTable, rows, true, errmsg);
+}
+
+/* Rows repeating a key within a batch are applied once: Update and Upsert
+   keep the last of them and Append the first, as writing one row at a time
+   would. writeBatch() reports the others as ignored.
+ */
+QString CSVStagingWriter::statement(const QBitArray &omitted) const
+{
+  QStringList names;
+  QStringList keys;
+  QStringList sets;
+  for (int c = 0; c < _plan->columnCount(); c++)
+  {
+    if (omitted.testBit(c))
+      continue;
+    names.append(_plan->columnName(c));
+    if (_plan->isKey(c))
+      keys.append(_plan->columnName(c));
+    else
+      sets.append(QString("%1 = s.%1").arg(_plan->columnName(c)));
+  }
+
+  if (_plan->action() == CSVMap::Update)
+    return QString("UPDATE %1 AS t SET %2"
+                   "  FROM (SELECT DISTINCT ON (%3) * FROM %4"
+                   "         ORDER BY %3, csvimp_row DESC) AS s"
+                   " WHERE %5;")
+             .arg(_plan->table(), sets.join(", "), keys.join(", "),
+                  StagingTable, keyMatch(omitted, "t", "s"));
+
+  if (_plan->action() == CSVMap::Upsert)
+    return QString("INSERT INTO %1 (%2)"
+                   " SELECT DISTINCT ON (s.%3) s.%4 FROM %5 AS s"
+                   "  ORDER BY s.%3, s.csvimp_row DESC%6;")
+             .arg(_plan->table(), names.join(", "), keys.join(", s."),
+                  names.join(", s."), StagingTable, _plan->conflictClause(omitted));
+
+  return QString("INSERT INTO %1 (%2)"
+                 " SELECT DISTINCT ON (s.%3) s.%4 FROM %5 AS s"
+                 "  WHERE NOT EXISTS (SELECT 1 FROM %1 AS t WHERE %6)"
+                 "  ORDER BY s.%3, s.csvimp_row;")
+           .arg(_plan->table(), names.join(", "), keys.join(", s."),
+                names.join(", s."), StagingTable, keyMatch(omitted, "t", "s"));
+}
@@ -0,0 +1,40 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVSTAGINGWRITER_H__
+#define __CSVSTAGINGWRITER_H__
+
+#include "csvcopywriter.h"
+
+/* Copies each batch into a temporary staging table and applies it to the
+   target table with a single set-based statement.
+ */
+class CSVStagingWriter : public CSVCopyWriter
+{
+  public:
+    static const QString StagingTable;
+
+    CSVStagingWriter(CSVImportPlan *plan, int batchSize = 0);
+    virtual ~CSVStagingWriter();
+
+  protected:
+    virtual bool writeBatch(const QList<CSVImportRow> &rows, QString *errmsg);
+    virtual void reconnected();
+    QString      keyMatch(const QBitArray &omitted, const QString &target,
+                          const QString &staged, bool nullsEqual = false) const;
+    bool         rowNumbers(const QString &sql, QList<int> &rows,
+                            QString *errmsg) const;
+    bool         stage(const QList<CSVImportRow> &rows, QString *errmsg);
+    QString      statement(const QBitArray &omitted) const;
+
+    bool         _created;  // the staging table has this plan's columns
+};
+
+#endif
@@ -10,15 +10,14 @@
 
 #include "csvtoolwindow.h"
 
+#include <QActionGroup>
+#include <QCryptographicHash>
+#include <QDomDocument>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QInputDialog>
-#include <QImageWriter>
-#include <QImageReader>
-#include <QBuffer>
 #include <QList>
-#include <QMap>
 #include <QMessageBox>
-#include <QMimeDatabase>
 #include <QPixmap>
 #include <QtGlobal>
 #if QT_VERSION >= 0x050000
@@ -37,12 +36,17 @@
 #include <QTimerEvent>
 #include <QVariant>
 
-#include <quuencode.h>
-
 #include "csvatlas.h"
 #include "csvatlaswindow.h"
+#include "csvattachmentloader.h"
+#include "csvcheckpoint.h"
 #include "csvdata.h"
 #include "csvimpdata.h"
+#include "csvimportpipeline.h"
+#include "csvimportplan.h"
+#include "csvimportwriter.h"
+#include "csvparallelwriter.h"
+#include "csvrejectwriter.h"
 #include "interactivemessagehandler.h"
 #include "logwindow.h"
 
@@ -50,8 +54,6 @@
 
 #define DEBUG false
 
-static const bool usetransaction = false;
-
 CSVToolWindow::CSVToolWindow(QWidget *parent, Qt::WindowFlags flags)
   : QMainWindow(parent, flags),
   _atlasWindow(0)
@@ -64,11 +66,30 @@ CSVToolWindow::CSVToolWindow(QWidget *parent, Qt::WindowFlags flags)
   (void)atlasWindow(); // initializes _atlasWindow
   _log         = new LogWindow(this);
   _data        = 0;
+  _plan        = 0;
+  _rejects     = 0;
+  _writer      = 0;
   _dbTimerId   = startTimer(60000);
   _currentDir  = QString {};
   _msghandler  = new InteractiveMessageHandler(this);
+  _parsePolicy = CSVData::KeepBadRows;
+  _resume      = false;
+  _commitRows    = -1;
+  _commitSeconds = -1;
+
+  _parsePolicyGroup = new QActionGroup(this);
+  parseKeepAction->setData(CSVData::KeepBadRows);
+  parseSkipAction->setData(CSVData::SkipBadRows);
+  parseQuarantineAction->setData(CSVData::QuarantineBadRows);
+  parseAbortAction->setData(CSVData::AbortOnBadRow);
+  _parsePolicyGroup->addAction(parseKeepAction);
+  _parsePolicyGroup->addAction(parseSkipAction);
+  _parsePolicyGroup->addAction(parseQuarantineAction);
+  _parsePolicyGroup->addAction(parseAbortAction);
+  parseKeepAction->setChecked(true);
 
   connect(_atlasWindow, SIGNAL(destroyed(QObject*)),      this, SLOT(cleanup(QObject*)));
+  connect(_parsePolicyGroup, SIGNAL(triggered(QAction*)), this, SLOT(sParsePolicy(QAction*)));
   connect(_delim,       SIGNAL(editTextChanged(QString)), this, SLOT(sNewDelimiter(QString)));
 }
 
@@ -79,6 +100,9 @@ CSVToolWindow::~CSVToolWindow()
     delete _atlasWindow;
     _atlasWindow = 0;
   }
+  delete _writer;
+  delete _plan;
+  delete _rejects;
 }
 
 void CSVToolWindow::languageChange()
@@ -115,35 +139,62 @@ void CSVToolWindow::fileOpen(QString filename)
   if (filename.isEmpty())
     filename = QFileDialog::getOpenFileName(this, tr("Select CSV File"),
                                             _currentDir,
-                                            QString("CSV Files (*.csv);;All files (*)"));
+                                            QString("CSV Files (*.csv);;Excel Workbooks (*.xlsx);;"
+                                                    "JSON Lines (*.jsonl *.ndjson);;All files (*)"));
 
   if (! filename.isEmpty())
   {
-    _currentDir = filename;
-    statusBar()->showMessage(tr("Loading %1...").arg(filename));
+    if (filename != "-")  // - is standard input
+      _currentDir = filename;
+    loadData(0, filename);
+  }
 
-    if (_data != 0)
-    {
-      delete _data;
-      _data = 0; // must 0 because sNewDelimiter refers to _data
-    }
-    _data = new CSVData(this, 0, sNewDelimiter(_delim->currentText()));
-    if (_msghandler)
-      _data->setMessageHandler(_msghandler);
+  _firstRowHeader->setEnabled(true);
+  fileOpenAction->setEnabled(true);
+}
 
-    if (_data->load(filename, this))
-    {
-      _data->setFirstRowHeaders(_firstRowHeader->isChecked());
+/* Read the data from an already open device, e.g. a pipe or a socket.
+   The suffix of name selects the format as it does for files.
+ */
+void CSVToolWindow::deviceOpen(QIODevice *device, QString name)
+{
+  if (! device)
+    return;
 
-      populate();
-      statusBar()->showMessage(tr("Done loading %1").arg(filename));
-    }
-  }
+  fileOpenAction->setEnabled(false);
+  _firstRowHeader->setEnabled(false);
+
+  loadData(device, name.isEmpty() ? tr("input stream") : name);
 
   _firstRowHeader->setEnabled(true);
   fileOpenAction->setEnabled(true);
 }
 
+void CSVToolWindow::loadData(QIODevice *device, const QString &name)
+{
+  statusBar()->showMessage(tr("Loading %1...").arg(name));
+
+  if (_data != 0)
+  {
+    delete _data;
+    _data = 0; // must 0 because sNewDelimiter refers to _data
+  }
+  _data = new CSVData(this, 0, sNewDelimiter(_delim->currentText()));
+  if (_msghandler)
+    _data->setMessageHandler(_msghandler);
+  _data->setParsePolicy(_parsePolicy);
+
+  _dataFile = device ? QString {} : name;
+  if (device ? _data->load(device, name, this) : _data->load(name, this))
+  {
+    _data->setFirstRowHeaders(_firstRowHeader->isChecked());
+
+    populate();
+    statusBar()->showMessage(tr("Done loading %1").arg(name));
+  }
+  reportParseIssues();
+}
+
 void CSVToolWindow::populate()
 {
   if (! _data)
@@ -299,6 +350,88 @@ YAbstractMessageHandler *CSVToolWindow::messageHandler() const
   return _msghandler;
 }
 
+CSVData::ParsePolicy CSVToolWindow::parsePolicy() const
+{
+  return _parsePolicy;
+}
+
+/* How to treat malformed records in the files loaded from now on; the file
+   already loaded keeps the records it was read with.
+ */
+void CSVToolWindow::setParsePolicy(CSVData::ParsePolicy policy)
+{
+  _parsePolicy = policy;
+  if (_data)
+    _data->setParsePolicy(policy);
+
+  QList<QAction*> actions = _parsePolicyGroup->actions();
+  for (int i = 0; i < actions.size(); i++)
+    if (actions.at(i)->data().toInt() == policy)
+      actions.at(i)->setChecked(true);
+}
+
+void CSVToolWindow::sParsePolicy(QAction *action)
+{
+  setParsePolicy(CSVData::ParsePolicy(action->data().toInt()));
+  statusBar()->showMessage(tr("Malformed records in the next file opened: %1")
+                           .arg(action->text().remove('&')));
+}
+
+void CSVToolWindow::reportParseIssues()
+{
+  if (! _data || _data->issues().isEmpty())
+    return;
+
+  // the full list can be as long as the file, so only show the first few
+  const int maxshown = 100;
+  QVector<CSVParseIssue> issues = _data->issues();
+
+  if (! _log)
+    _log = new LogWindow(this);
+
+  QString name = _dataFile.isEmpty() ? tr("input stream") : _dataFile;
+  _log->_log->append(tr("File: %1\n"
+                        "# Malformed Records: %2\n"
+                        "# Quarantined:       %3\n\n")
+                     .arg(name).arg(issues.size())
+                     .arg(_data->quarantined().size()));
+  for (int i = 0; i < issues.size() && i < maxshown; i++)
+    _log->_log->append(CSVData::describe(issues.at(i)));
+  if (issues.size() > maxshown)
+    _log->_log->append(tr("... and %1 more").arg(issues.size() - maxshown));
+
+  // keep the quarantined records where they can be fixed and imported again
+  QList<QStringList> quarantined = _data->quarantined();
+  if (! quarantined.isEmpty())
+  {
+    QFileInfo datafile(_dataFile);
+    CSVRejectWriter quarantine(datafile.isFile()
+                               ? datafile.absolutePath() + "/" +
+                                 datafile.completeBaseName() + ".quarantine.csv"
+                               : QString("csvimp.quarantine.csv"),
+                               _data->delimiter());
+    if (_data->firstRowHeaders())
+    {
+      QStringList headers;
+      for (unsigned int c = 0; c < _data->columns(); c++)
+        headers.append(_data->header(c));
+      quarantine.write(headers);
+    }
+    for (int r = 0; r < quarantined.size(); r++)
+      quarantine.write(quarantined.at(r));
+
+    if (quarantine.close())
+      _log->_log->append(tr("\nQuarantined records were written to %1")
+                         .arg(quarantine.fileName()));
+    else
+      _log->_log->append(tr("\nCould not write quarantined records to %1: %2")
+                         .arg(quarantine.fileName(), quarantine.errorString()));
+  }
+
+  statusBar()->showMessage(tr("%1 malformed records in %2")
+                           .arg(issues.size()).arg(name));
+}
+
 void CSVToolWindow::sFirstRowHeader( bool firstisheader )
 {
   if(_data && _data->firstRowHeaders() != firstisheader)
@@ -404,7 +537,8 @@ bool CSVToolWindow::importStart()
 
   CSVMap::Action action = map.action();
 
-  if (!(action == CSVMap::Insert || action == CSVMap::Update || action == CSVMap::Append) )
+  if (!(action == CSVMap::Insert || action == CSVMap::Update ||
+        action == CSVMap::Append || action == CSVMap::Upsert) )
   {
     _msghandler->message(QtWarningMsg, tr("Action not implemented"),
                          tr("<p>The action %1 for this map is not supported.")
@@ -412,6 +546,15 @@ bool CSVToolWindow::importStart()
     return false;
   }
 
+  // fixed-width and JSON maps carry their own layout; reparse the file to match it
+  if (_data && (_data->fixedWidthLayout() != map.fixedWidthLayout() ||
+                _data->jsonColumns()      != map.jsonColumns()))
+  {
+    _data->setFixedWidthLayout(map.fixedWidthLayout());
+    _data->setJsonColumns(map.jsonColumns());
+    populate();
+  }
+
   if (!_data || _data->rows() < 1)
   {
     _msghandler->message(QtWarningMsg, tr("No data"),
@@ -424,10 +567,67 @@ bool CSVToolWindow::importStart()
   _current = 0;
   _error = 0;
   _ignored = 0;
+  _errorList.clear();
+  _unlogged = 0;
 
   if (! _log)
     _log = new LogWindow(this);
 
+  /* Several connections commit independently, so for Insert the rows below
+     the lowest committed row are not all that is committed; resuming from
+     there would insert some rows twice.
+   */
+  QDomDocument mapdoc;
+  mapdoc.appendChild(map.createElement(mapdoc));
+  QString settings = QString("%1|%2|%3|%4")
+                       .arg(CSVData::parsePolicyToName(_data->parsePolicy()))
+                       .arg(_data->firstRowHeaders())
+                       .arg(_data->delimiter())
+                       .arg(QString::fromLatin1(QCryptographicHash::hash(
+                              mapdoc.toByteArray(), QCryptographicHash::Sha1).toHex()));
+  CSVCheckpoint checkpoint(_dataFile, map.name(), settings);
+  bool checkpointed = checkpoint.isValid() &&
+                      ! (map.connections() > 1 && action == CSVMap::Insert);
+  int  first        = 0;
+  if (checkpointed && _resume && checkpoint.load())
+  {
+    first = checkpoint.lastCommittedRow() + 1;
+    _log->_log->append(tr("Resuming the import of %1 after record %2.\n")
+                       .arg(_dataFile).arg(first));
+  }
+  else if (checkpointed)
+  {
+    if (_resume && ! checkpoint.errorString().isEmpty())
+      _log->_log->append(tr("Cannot resume the import of %1: %2. "
+                            "Importing from the first record.\n")
+                         .arg(_dataFile, checkpoint.errorString()));
+    checkpoint.remove();
+  }
+
+  delete _writer;
+  delete _plan;
+  delete _rejects;
+  _plan   = new CSVImportPlan(map);
+  if (map.connections() > 1)
+    _writer = new CSVParallelWriter(_plan, map, map.connections());
+  else
+    _writer = CSVImportWriter::create(_plan, map);
+
+  // a resumed import adds to the records the interrupted one rejected
+  QFileInfo datafile(_dataFile);
+  if (datafile.isFile())
+    _rejects = new CSVRejectWriter(datafile.absolutePath() + "/" +
+                                   datafile.completeBaseName() + ".rejects.csv",
+                                   _data->delimiter(), first > 0);
+  else
+    _rejects = new CSVRejectWriter("csvimp.rejects.csv", _data->delimiter());
+  _rejects->setFixedWidthLayout(_data->fixedWidthLayout());
+
+  int commitRows    = _commitRows    >= 0 ? _commitRows    : map.commitRows();
+  int commitSeconds = _commitSeconds >= 0 ? _commitSeconds : map.commitSeconds();
+  bool usetransaction = commitRows > 0 || commitSeconds > 0;
+  _writer->setCommitInterval(commitRows, commitSeconds);
+
   if(usetransaction) QSqlQuery begin("BEGIN;");
 
   _errMsg = QString("");
@@ -469,41 +669,41 @@ bool CSVToolWindow::importStart()
   progress->setWindowModality(Qt::WindowModal);
   bool userCanceled = false;
 
-  for(_current = 0; _current < _total; ++_current)
+  // bind rows and load their attachments on worker threads while this one writes
+  CSVAttachmentLoader loader(_plan);
+  CSVImportPipeline *pipeline = new CSVImportPipeline(_plan, _data, first, _total,
+                                                      0, &loader);
+  QList<CSVImportRow> rows;
+  _current = first;
+  while (pipeline->next(rows))
   {
-    if(usetransaction) QSqlQuery savepoint("SAVEPOINT csvinsert;");
-    switch(action)
+    for (int r = 0; r < rows.size(); r++, ++_current)
     {
-      case CSVMap::Insert:  // INSERT new records
-      {
-        insertAction();
-        break;
-      }
-      case CSVMap::Update: // UPDATE existing records
-      {
-        updateAction();
-        break;
-      }
-      case CSVMap::Append: // APPEND new records, ignore existing
-      {
-        insertAction(true);
-        break;
-      }
+      logMessages(rows.at(r).warnings);
+      _writer->add(rows.at(r));
     }
+    collectErrors();
+    if (checkpointed && _writer->lastCommittedRow() > checkpoint.lastCommittedRow())
+      checkpoint.save(_writer->lastCommittedRow());
 
     if (progress->wasCanceled())
     {
       userCanceled = true;
       break;
     }
-    if(! (_current % 1000))
-    {
-      progress->setLabelText(progresstext.arg(map.name()).arg(_current).arg(expected));
-      progress->setValue(_current);
-    }
+    progress->setLabelText(progresstext.arg(map.name()).arg(_current).arg(expected));
+    progress->setValue(_current);
   }
+  delete pipeline;
+  if (! userCanceled)   // a cancel rolls back what has not been committed
+    _writer->flush();
   progress->setValue(_total);
 
+  _error   += _writer->failed();
+  _ignored += _writer->ignored();
+  collectErrors();
+  _rejects->close();
+
   if (_error || _ignored || userCanceled)
   {
     _log->_log->append(tr("Map: %1\n"
@@ -512,12 +712,22 @@ bool CSVToolWindow::importStart()
                           "Total Records: %4\n"
                           "# Processed:   %5\n"
                           "# Ignored:     %6\n"
-                          "# Errors:      %7\n\n")
+                          "# Skipped:     %7\n"
+                          "# Errors:      %8\n\n")
                           .arg(map.name()).arg(map.table())
                           .arg(CSVMap::actionToName(map.action()))
-                          .arg(_total).arg(_current).arg(_ignored).arg(_error));
+                          .arg(_total).arg(_current).arg(_ignored)
+                          .arg(_writer->skipped()).arg(_error));
     _log->_log->append(_errMsg);
     _log->_log->append(_errorList.join("\n"));
+    if (_unlogged)
+      _log->_log->append(tr("\n... and %1 more messages.").arg(_unlogged));
+    if (_rejects->records())
+      _log->_log->append(tr("\nFailed records were written to %1")
+                         .arg(_rejects->fileName()));
+    if (! _rejects->errorString().isEmpty())
+      _log->_log->append(tr("\nCould not write failed records to %1: %2")
+                         .arg(_rejects->fileName(), _rejects->errorString()));
     _log->show();
     _log->raise();
     if (_msghandler &&  // log messages there's a non-interactive message handler
@@ -539,10 +749,19 @@ bool CSVToolWindow::importStart()
       _log->show();
       _log->raise();
       if(usetransaction) QSqlQuery rollback("ROLLBACK;");
+      _writer->rollback();
+      if (checkpointed && _writer->lastCommittedRow() > checkpoint.lastCommittedRow())
+        checkpoint.save(_writer->lastCommittedRow());
+      QString rolledback = tr("changes were rolled back");
+      if (usetransaction && _writer->lastCommittedRow() >= 0)
+        rolledback = tr("records up to %1 were committed; later changes "
+                        "were rolled back")
+                       .arg(_writer->lastCommittedRow() + 1);
       _msghandler->message(QtCriticalMsg, tr("Error"),
                            tr("<p>There was an error running the post sql "
-                              "query and changes were rolled back. "
-                              "\n\n----------------------\n%1").arg(_errMsg));
+                              "query and %1. "
+                              "\n\n----------------------\n%2")
+                             .arg(rolledback, _errMsg));
       return false;
     }
   }
@@ -550,12 +769,42 @@ bool CSVToolWindow::importStart()
   if (userCanceled)
   {
     if(usetransaction) QSqlQuery rollback("ROLLBACK;");
-    _log->_log->append(tr("\n\nImport canceled by user. Changes were rolled back."));
+    _writer->rollback();
+    if (checkpointed && _writer->lastCommittedRow() > checkpoint.lastCommittedRow())
+      checkpoint.save(_writer->lastCommittedRow());
+    if (usetransaction && _writer->lastCommittedRow() >= 0)
+      _log->_log->append(tr("\n\nImport canceled by user. Records up to %1 "
+                            "were committed; later changes were rolled back.")
+                         .arg(_writer->lastCommittedRow() + 1));
+    else
+      _log->_log->append(tr("\n\nImport canceled by user. Changes were rolled back."));
 
     return false;
   }
 
-  if(usetransaction) QSqlQuery commit("COMMIT");
+  /* A commit that fails takes its rows with it, so the import did not
+     complete; keep the checkpoint to resume from.
+   */
+  if (! _writer->commit(false))
+  {
+    int logged = _errorList.size();
+    _error = _writer->failed();
+    collectErrors();
+    if (checkpointed && _writer->lastCommittedRow() > checkpoint.lastCommittedRow())
+      checkpoint.save(_writer->lastCommittedRow());
+    _log->_log->append(tr("\n\nThe final commit failed; records after %1 "
+                          "were not imported.\n")
+                       .arg(_writer->lastCommittedRow() + 1));
+    _log->_log->append(_errorList.mid(logged).join("\n"));
+    _log->show();
+    _log->raise();
+    _msghandler->message(QtCriticalMsg, tr("Error"),
+                         tr("<p>The import of %1 could not be committed.")
+                         .arg(_dataFile));
+    return false;
+  }
+  if (checkpointed)
+    checkpoint.remove();
   if (! _error)
   {
     _msghandler->message(QtDebugMsg, tr("Import Complete"),
@@ -567,480 +816,118 @@ bool CSVToolWindow::importStart()
   return false;
 }
 
-void CSVToolWindow::insertAction( bool append )
+/* Move the writer's errors out of it as the import goes. Failed records
+   go to the reject file, with their SQLSTATE and message in two extra
+   columns so the file can be fixed and imported again with the same map.
+   Only the first MaxMessages messages are kept for the log.
+ */
+void CSVToolWindow::collectErrors()
 {
-  QString query;
-  QString front;
-  QString back;
-  QString wherenot;
-  QString value;
-  QString label;
-  QVariant var;
-  QString  _fileName;
-  QMimeDatabase mimedb;
-  QString mimetype;
-  bool foundMimeType = false;
-  CSVMapField::FileType filetype;
-
-  query = QString("INSERT INTO %1 ").arg(map.table());
-  wherenot = QString(" WHERE NOT EXISTS (SELECT 1 FROM %1 WHERE ").arg(map.table());
-  front = "(";
-  back = append ? " SELECT " : " VALUES(";
-  QList<CSVMapField> fields = map.fields();
-  QMap<QString,QVariant> values;
-  QMap<QString,QVariant> wheres;
-  for (int i = 0; i < fields.size(); i++)
+  QList<CSVImportError> errors = _writer->takeErrors();
+  for (int e = 0; e < errors.size(); e++)
   {
-    switch(fields.at(i).action())
+    const CSVImportError &error = errors.at(e);
+    if (error.kind == CSVImportError::Failed && error.row >= 0)
     {
-      // Use Column Values
-      case CSVMapField::Action_UseColumn:
-      {
-        value = _data->value(_current, fields.at(i).column()-1);
-        if(value.isNull())
-        {
-          switch (fields.at(i).ifNullAction())
-          {
-            case CSVMapField::UseDefault:
-              continue;
-            case CSVMapField::UseEmptyString:
-            {
-              var = QVariant(QString(""));
-              break;
-            }
-            case CSVMapField::UseAlternateValue:
-            {
-              var = QVariant(fields.at(i).valueAlt());
-              break;
-            }
-            case CSVMapField::UseAlternateColumn:
-            {
-              value = _data->value(_current, fields.at(i).columnAlt()-1);
-              if(value.isNull())
-              {
-                switch (fields.at(i).ifNullActionAlt())
-                {
-                  case CSVMapField::UseDefault:
-                    continue;
-                  case CSVMapField::UseEmptyString:
-                  {
-                    var = QVariant(QString(""));
-                    break;
-                  }
-                  case CSVMapField::UseAlternateValue:
-                  {
-                    var = QVariant(fields.at(i).valueAlt());
-                    break;
-                  }
-                  default: // Nothing
-                    var = QVariant(QString {});
-                }
-              }
-              else
-                var = QVariant(value);
-              break;
-            }
-            default: // Nothing
-              var = QVariant(QString {});
-          }
-        }
-        else
-          var = QVariant(value);
-        break;
-      }
-      // Load File from Column location and encode appropriately
-      case CSVMapField::Action_SetColumnFromDataFile:
-      {
-        value = _data->value(_current, fields.at(i).column()-1);
-        filetype = (fields.at(i).fileType());
-
-        if(value.isNull())
-          var = QVariant(QString {}); // Nothing (error)
-        else
-        {
-          _fileName = value;
-          switch (filetype)
-          {
-            case CSVMapField::TYPE_IMAGE:
-            {
-              var = imageLoadAndEncode(_fileName);
-              if (var == false)
-                var = QVariant(QString {}); // Nothing (error)
-              break;
-            }
-            case CSVMapField::TYPE_IMAGEENC:
-            {
-              var = imageLoadAndEncode(_fileName, true);
-              if (var == false)
-                var = QVariant(QString {}); // Nothing (error)
-              break;
-            }
-            case CSVMapField::TYPE_FILE:
-            {
-              var = docLoadAndEncode(_fileName);
-              if (var == false)
-                var = QVariant(QString {}); // Nothing (error)
-              else
-                mimetype = mimedb.mimeTypeForFile(QFileInfo(_fileName)).name();
-              break;
-            }
-            default:
-              var = QVariant(value);
-          }
-        }
-        break;
-      }
-      case CSVMapField::Action_UseEmptyString:
+      QStringList fields;
+      if (_rejects->records() == 0 && ! _rejects->appending() &&
+          _data->firstRowHeaders())
       {
-        var = QVariant(QString(""));
-        break;
+        for (unsigned int c = 0; c < _data->columns(); c++)
+          fields.append(_data->header(c));
+        fields << "csvimp_error_code" << "csvimp_error";
+        _rejects->write(fields);
+        fields.clear();
       }
-      case CSVMapField::Action_UseAlternateValue:
-      {
-        var = QVariant(fields.at(i).valueAlt());
-        break;
-      }
-      case CSVMapField::Action_UseNull:
-      {
-       var = QVariant(QString {});
-        break;
-      }
-      default:
-        continue;
+      for (unsigned int c = 0; c < _data->columns(); c++)
+        fields.append(_data->value(error.row, c));
+      fields << error.code << error.message;
+      _rejects->write(fields);
     }
 
-    label = ":" + fields.at(i).name();
-    if(!values.empty())
-    {
-      front += ", ";
-      back  += ", ";
-    }
-    values.insert(label, var);
-    front += fields.at(i).name();
-    back  += label;
-
-    if (append && fields.at(i).isKey())
-    {
-      if(!wheres.empty())
-        wherenot += " AND ";
-      wherenot += fields.at(i).name() + "=" + label;
-      wheres.insert(label, var);
-    }
-
-    if (fields.at(i).name() == "file_mime_type")
-      foundMimeType = true;
-  }
-
-  if (!foundMimeType && !mimetype.isEmpty())
-  {
-    values.insert(":file_mime_type", mimetype);
-    front += ", file_mime_type";
-    back  += ", :file_mime_type";
-  }
-
-  if(values.empty())
-  {
-    _ignored++;
-    _errMsg = QString("IGNORED Record %1: There are no columns to append").arg(_current+1);
-    _errorList.append(_errMsg);
-    return;
-  }
-
-  if(append && wheres.empty())
-  {
-    if(usetransaction) QSqlQuery sprollback("ROLLBACK TO SAVEPOINT csvinsert;");
-    _error++;
-    _errMsg = QString("No Key defined in Altas Map.");
-    _errorList.append(_errMsg);
-  }
-
-  front += ") ";
-  back += append ? " " : ")";
-  query += front + back;
-  if (append)
-    query += wherenot + ");";
-  QSqlQuery qry;
-  qry.prepare(query);
-  QMap<QString,QVariant>::iterator vit;
-  for(vit = values.begin(); vit != values.end(); ++vit)
-    qry.bindValue(vit.key(), vit.value());
-
-  if(!qry.exec())
-  {
-    if(usetransaction) QSqlQuery sprollback("ROLLBACK TO SAVEPOINT csvinsert;");
-    _error++;
-    _errMsg = QString("ERROR Record %1: %2").arg(_current+1).arg(qry.lastError().text());
-    _errorList.append(_errMsg);
+    logMessages(QStringList(error.message));
   }
 }
 
-void CSVToolWindow::updateAction()
+// keep messages for the log, up to MaxMessages per import
+void CSVToolWindow::logMessages(const QStringList &messages)
 {
-  QString query;
-  QString set;
-  QString where;
-  QString value;
-  QString label;
-  QVariant var;
-  QString  _fileName;
-  QMimeDatabase mimedb;
-  QString mimetype;
-  bool foundMimeType = false;
-  CSVMapField::FileType filetype;
-
-  query = QString("UPDATE %1 SET ").arg(map.table());
-  where = QString(" WHERE ");
-  QList<CSVMapField> fields = map.fields();
-  QMap<QString,QVariant> values;
-  QMap<QString,QVariant> wheres;
-  for (int i = 0; i < fields.size(); i++)
-  {
-    switch(fields.at(i).action())
-    {
-      // Use Column Values
-      case CSVMapField::Action_UseColumn:
-      {
-        value = _data->value(_current, fields.at(i).column()-1);
-        if(value.isNull())
-        {
-          switch (fields.at(i).ifNullAction())
-          {
-            case CSVMapField::UseDefault:
-              continue;
-            case CSVMapField::UseEmptyString:
-            {
-              var = QVariant(QString(""));
-              break;
-            }
-            case CSVMapField::UseAlternateValue:
-            {
-              var = QVariant(fields.at(i).valueAlt());
-              break;
-            }
-            case CSVMapField::UseAlternateColumn:
-            {
-              value = _data->value(_current, fields.at(i).columnAlt()-1);
-              if(value.isNull())
-              {
-                switch (fields.at(i).ifNullActionAlt())
-                {
-                  case CSVMapField::UseDefault:
-                    continue;
-                  case CSVMapField::UseEmptyString:
-                  {
-                    var = QVariant(QString(""));
-                    break;
-                  }
-                  case CSVMapField::UseAlternateValue:
-                  {
-                    var = QVariant(fields.at(i).valueAlt());
-                    break;
-                  }
-                  default: // Nothing
-                    var = QVariant(QString {});
-                }
-              }
-              else
-                var = QVariant(value);
-              break;
-            }
-            default: // Nothing
-              var = QVariant(QString {});
-          }
-        }
-        else
-          var = QVariant(value);
-        break;
-      }
-      // Load File from Column location and encode appropriately
-      case CSVMapField::Action_SetColumnFromDataFile:
-      {
-        value = _data->value(_current, fields.at(i).column()-1);
-        filetype = (fields.at(i).fileType());
-
-        if(value.isNull())
-          var = QVariant(QString {}); // Nothing (error)
-        else
-        {
-          _fileName = value;
-          switch (filetype)
-          {
-            case CSVMapField::TYPE_IMAGE:
-            {
-              var = imageLoadAndEncode(_fileName);
-              if (var == false)
-                var = QVariant(QString {}); // Nothing (error)
-              break;
-            }
-            case CSVMapField::TYPE_IMAGEENC:
-            {
-              var = imageLoadAndEncode(_fileName, true);
-              if (var == false)
-                var = QVariant(QString {}); // Nothing (error)
-              break;
-            }
-            case CSVMapField::TYPE_FILE:
-            {
-              var = docLoadAndEncode(_fileName);
-              if (var == false)
-                var = QVariant(QString {}); // Nothing (error)
-              else
-                mimetype = mimedb.mimeTypeForFile(QFileInfo(_fileName)).name();
-              break;
-            }
-            default:
-              var = QVariant(value);
-          }
-        }
-        break;
-      }
-      case CSVMapField::Action_UseEmptyString:
-      {
-        var = QVariant(QString(""));
-        break;
-      }
-      case CSVMapField::Action_UseAlternateValue:
-      {
-        var = QVariant(fields.at(i).valueAlt());
-        break;
-      }
-      case CSVMapField::Action_UseNull:
-      {
-       var = QVariant(QString {});
-        break;
-      }
-      default:
-        continue;
-    }
-
-    label = ":" + fields.at(i).name();
-    if (fields.at(i).isKey())
-    {
-      if(!wheres.empty())
-        where += " AND ";
-      where += fields.at(i).name() + "=" + label;
-      wheres.insert(label, var);
-    }
-      else
-    {
-      if(!values.empty())
-        set += ", ";
-      set += fields.at(i).name() + "=" + label;
-      values.insert(label, var);
-    }
-
-    if (fields.at(i).name() == "file_mime_type")
-      foundMimeType = true;
-  }
-
-  if (!foundMimeType && !mimetype.isEmpty())
-  {
-    set += ", file_mime_type=:file_mime_type";
-    values.insert(":file_mime_type", mimetype);
-  }
-
-  if(values.empty())
-  {
-    _ignored++;
-    _errMsg = QString("IGNORED Record %1: There are no columns to update").arg(_current+1);
-    _errorList.append(_errMsg);
-    return;
-  }
-
-  if(wheres.empty())
+  for (int m = 0; m < messages.size(); m++)
   {
-    if(usetransaction) QSqlQuery sprollback("ROLLBACK TO SAVEPOINT csvinsert;");
-    _error++;
-    _errMsg = QString("No Key defined in Altas Map.");
-    _errorList.append(_errMsg);
-  }
-
-  query += set + where;
-  QSqlQuery qry;
-  qry.prepare(query);
-  QMap<QString,QVariant>::iterator vit;
-  for(vit = values.begin(); vit != values.end(); ++vit)
-    qry.bindValue(vit.key(), vit.value());
-  for(vit = wheres.begin(); vit != wheres.end(); ++vit)
-    qry.bindValue(vit.key(), vit.value());
-
-  if(!qry.exec())
-  {
-    if(usetransaction) QSqlQuery sprollback("ROLLBACK TO SAVEPOINT csvinsert;");
-    _error++;
-    _errMsg = QString("ERROR Record %1: %2").arg(_current+1).arg(qry.lastError().text());
-    _errorList.append(_errMsg);
+    if (_errorList.size() < MaxMessages)
+      _errorList.append(messages.at(m));
+    else
+      _unlogged++;
   }
 }
 
 QVariant CSVToolWindow::imageLoadAndEncode(QString fileName, bool enc)
 {
-  QImageWriter imageIo;
-  QBuffer  imageBuffer;
-  QString  imageString;
-
-  if (fileName.length() > 1)
-  {
-    if(!__image.load(fileName))
-    {
-       QMessageBox::warning(this, tr("Could not load file"),
-                   tr( "Could not load file %1.\n"
-                       "The file is not an image, an unknown image format or is corrupt" ).arg(fileName) );
-       return false;
-    }
-  }
-
-  if (__image.isNull())
+  QString  errmsg;
+  QVariant var = CSVAttachmentLoader::loadImage(fileName, enc, &errmsg);
+  if (var.isNull())
   {
-    QMessageBox::warning(this, tr("No Image Specified"),
-               tr("You must load an image before you may save this record.") );
+    QMessageBox::warning(this, tr("Could not load image"), errmsg);
     return false;
   }
 
-  imageBuffer.open(QIODevice::ReadWrite);
-  imageIo.setDevice(&imageBuffer);
-  imageIo.setFormat("PNG");
+  return var;
+}
 
-  if (!imageIo.write(__image))
+QVariant CSVToolWindow::docLoadAndEncode(QString fileName)
+{
+  QString  errmsg;
+  QVariant var = CSVAttachmentLoader::loadDocument(fileName, &errmsg);
+  if (var.isNull())
   {
-    QMessageBox::critical(this, tr("Error Saving Image"),
-               tr("There was an error trying to save the image (%1).").arg(fileName) );
+    QMessageBox::warning(this, tr("File Error"), errmsg);
     return false;
   }
 
-  imageBuffer.close();
-  imageString = enc ? QUUEncode(imageBuffer) : imageBuffer.buffer();
+  return var;
+}
+
+void CSVToolWindow::sImportViewLog()
+{
+  _log->show();
+}
 
-  return QVariant(imageString);
+/* Import like importStart() but, if an earlier import of the same file with
+   the same map stopped, start after the last record it committed.
+ */
+bool CSVToolWindow::importResume()
+{
+  bool resume = _resume;
+  _resume = true;
+  bool result = importStart();
+  _resume = resume;
+  return result;
 }
 
-QVariant CSVToolWindow::docLoadAndEncode(QString fileName)
+// the last record of the latest import known to be committed, or -1
+int CSVToolWindow::lastCommittedRow() const
 {
-  QByteArray  bytarr;
-  QFileInfo fi(fileName);
+  return _writer ? _writer->lastCommittedRow() : -1;
+}
 
-  if (!fi.exists())
-  {
-    QMessageBox::warning( this, tr("File Error"),
-       tr("File %1 was not found and will not be saved.").arg(fileName));
-    return false;
-  }
+/* Override the map's commit interval for the following imports. A negative
+   rows uses the interval of each map.
+ */
+void CSVToolWindow::setCommitInterval(int rows, int seconds)
+{
+  _commitRows    = rows;
+  _commitSeconds = rows < 0 ? -1 : qMax(seconds, 0);
+}
 
-  QFile sourceFile(fileName);
-  if (!sourceFile.open(QIODevice::ReadOnly))
-  {
-    QMessageBox::warning( this, tr("File Open Error"),
-             tr("Could not open source file %1 for read.")
-                        .arg(fileName));
-    return false;
-  }
-  bytarr = sourceFile.readAll();
-  return QVariant(bytarr);
+// whether importStart() picks up where an earlier import stopped
+bool CSVToolWindow::resume() const
+{
+  return _resume;
 }
 
-void CSVToolWindow::sImportViewLog()
+void CSVToolWindow::setResume(bool resume)
 {
-  _log->show();
+  _resume = resume;
 }
 
 void CSVToolWindow::setDir(QString dirname)
@@ -12,10 +12,16 @@
 #define CSVTOOLWINDOW_H
 
 #include "ui_csvtoolwindow.h"
+#include "csvdata.h"
 #include "csvmap.h"
 
 class CSVAtlasWindow;
-class CSVData;
+class QAction;
+class QActionGroup;
+class CSVImportPlan;
+class CSVImportWriter;
+class CSVRejectWriter;
+class QIODevice;
 class QTimerEvent;
 class LogWindow;
 class YAbstractMessageHandler;
@@ -31,9 +37,16 @@ class CSVToolWindow : public QMainWindow, public Ui::CSVToolWindow
 
     YAbstractMessageHandler *messageHandler() const;
     void                     setMessageHandler(YAbstractMessageHandler *handler);
+    CSVData::ParsePolicy     parsePolicy()    const;
+    void                     setParsePolicy(CSVData::ParsePolicy policy);
+    int                      lastCommittedRow() const;
+    void                     setCommitInterval(int rows, int seconds = 0);
+    bool                     resume()         const;
+    void                     setResume(bool resume);
 
   public slots:
     void clearImportLog();
+    void deviceOpen(QIODevice *device, QString name = QString());
     void fileExit();
     void fileNew();
     void fileOpen(QString filename = QString());
@@ -43,10 +56,9 @@ class CSVToolWindow : public QMainWindow, public Ui::CSVToolWindow
     void helpAbout();
     void helpContents();
     void helpIndex();
-    void insertAction(bool append = false);
-    void updateAction();
     QVariant imageLoadAndEncode(QString fileName, bool enc = false);
     QVariant docLoadAndEncode(QString fileName);
+    bool importResume();
     bool importStart();
     void mapEdit();
     void sFirstRowHeader(bool yes);
@@ -58,23 +70,39 @@ class CSVToolWindow : public QMainWindow, public Ui::CSVToolWindow
   protected slots:
     void languageChange();
     void cleanup(QObject *deadobj);
+    void sParsePolicy(QAction *action);
 
   protected:
+    static const int MaxMessages = 1000;  // kept for the log per import
+
     CSVAtlasWindow *_atlasWindow;
+    int             _commitRows;
+    int             _commitSeconds;
     QString         _currentDir;
     CSVData        *_data;
+    QString         _dataFile;
     int             _dbTimerId;
     LogWindow      *_log;
     YAbstractMessageHandler *_msghandler;
+    CSVData::ParsePolicy     _parsePolicy;
+    QActionGroup            *_parsePolicyGroup;
+    CSVImportPlan  *_plan;
+    CSVRejectWriter *_rejects;
+    bool            _resume;
+    CSVImportWriter *_writer;
+    void collectErrors();
+    void loadData(QIODevice *device, const QString &name);
+    void logMessages(const QStringList &messages);
     void populate();
+    void reportParseIssues();
 
   private:
-    QImage      __image;
     int         _total;
     int         _current;
     int         _error;
     int         _ignored;
     QStringList _errorList;
+    int         _unlogged;
     QString     _errMsg;
     CSVMap map;
 };
@@ -0,0 +1,156 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "csvvalueswriter.h"
+
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+
+#define DEBUG false
+
+// the server accepts at most 65535 parameters per statement
+CSVValuesWriter::CSVValuesWriter(CSVImportPlan *plan, int batchSize)
+  : CSVImportWriter(plan, qMin(batchSize > 0 ? batchSize : int(DefaultBatchSize),
+                               MaxParameters / qMax(plan->columnCount(), 1)))
+{
+}
+
+CSVValuesWriter::~CSVValuesWriter()
+{
+  QHash<QPair<QBitArray, int>, QSqlQuery*>::iterator it;
+  for (it = _statements.begin(); it != _statements.end(); ++it)
+    delete it.value();
+}
+
+void CSVValuesWriter::reconnected()
+{
+  CSVImportWriter::reconnected();
+  qDeleteAll(_statements);
+  _statements.clear();
+}
+
+// a failing statement fails the whole batch, so a single row needs the
+// batch's savepoint
+bool CSVValuesWriter::rowSavepoints() const
+{
+  return false;
+}
+
+bool CSVValuesWriter::writeBatch(const QList<CSVImportRow> &rows, QString *errmsg)
+{
+  const QBitArray &omitted = rows.first().omitted;
+  QSqlQuery *qry = statement(omitted, rows.size(), errmsg);
+  if (! qry)
+    return false;
+
+  int b = 0;
+  for (int r = 0; r < rows.size(); r++)
+    for (int c = 0; c < _plan->columnCount(); c++)
+      if (! omitted.testBit(c))
+        qry->bindValue(b++, rows.at(r).values.at(c));
+
+  if (! qry->exec())
+  {
+    if (errmsg)
+      *errmsg = qry->lastError().text();
+    return false;
+  }
+
+  _written += rows.size();
+  return true;
+}
+
+/* Append and Upsert cannot use a plain VALUES list: Append has to check
+   each row against the table and an Upsert statement may not touch the same
+   row twice. The rows become a derived table instead, and DISTINCT ON keeps
+   only one of rows repeating a key within the batch, the first for Append
+   and the last for Upsert, as writing them one at a time would. Derived
+   table columns get no type from the insert target, hence the casts on the
+   first row.
+ */
+QSqlQuery *CSVValuesWriter::statement(const QBitArray &omitted, int rows, QString *errmsg)
+{
+  QPair<QBitArray, int> shape = qMakePair(omitted, rows);
+  if (_statements.contains(shape))
+    return _statements.value(shape);
+
+  bool derived = _plan->action() == CSVMap::Append ||
+                 _plan->action() == CSVMap::Upsert;
+
+  QStringList names;
+  QStringList firstRow;
+  QStringList keys;
+  QStringList wheres;
+  for (int c = 0; c < _plan->columnCount(); c++)
+  {
+    if (omitted.testBit(c))
+      continue;
+    names.append(_plan->columnName(c));
+    if (derived)
+    {
+      firstRow.append(QString("CAST(? AS %1)").arg(_plan->columnType(c)));
+      if (_plan->isKey(c))
+      {
+        keys.append("v." + _plan->columnName(c));
+        wheres.append(QString("%1.%2 = v.%2").arg(_plan->table(), _plan->columnName(c)));
+      }
+    }
+  }
+
+  QString placeholders = QString("?, ").repeated(names.size());
+  placeholders.chop(2);
+
+  QStringList tuples;
+  QString sql;
+  if (derived)
+  {
+    tuples.append(QString("(0, %1)").arg(firstRow.join(", ")));
+    for (int r = 1; r < rows; r++)
+      tuples.append(QString("(%1, %2)").arg(r).arg(placeholders));
+
+    sql = QString("INSERT INTO %1 (%2)"
+                  " SELECT DISTINCT ON (%3) v.%4"
+                  "   FROM (VALUES %5) AS v(csvimp_row, %2)")
+            .arg(_plan->table(), names.join(", "), keys.join(", "),
+                 names.join(", v."), tuples.join(", "));
+    if (_plan->action() == CSVMap::Append)
+      sql += QString("  WHERE NOT EXISTS (SELECT 1 FROM %1 WHERE %2)"
+                     "  ORDER BY %3, v.csvimp_row;")
+               .arg(_plan->table(), wheres.join(" AND "), keys.join(", "));
+    else
+      sql += QString("  ORDER BY %1, v.csvimp_row DESC%2;")
+               .arg(keys.join(", "), _plan->conflictClause(omitted));
+  }
+  else
+  {
+    for (int r = 0; r < rows; r++)
+      tuples.append(QString("(%1)").arg(placeholders));
+
+    sql = QString("INSERT INTO %1 (%2) VALUES %3;")
+            .arg(_plan->table(), names.join(", "), tuples.join(", "));
+  }
+
+  if (DEBUG)
+    qDebug("CSVValuesWriter::statement() preparing %d rows of %d columns",
+           rows, names.size());
+
+  QSqlQuery *qry = new QSqlQuery(_plan->database());
+  if (! qry->prepare(sql))
+  {
+    if (errmsg)
+      *errmsg = qry->lastError().text();
+    delete qry;
+    return 0;
+  }
+
+  _statements.insert(shape, qry);
+  return qry;
+}
@@ -0,0 +1,41 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __CSVVALUESWRITER_H__
+#define __CSVVALUESWRITER_H__
+
+#include <QBitArray>
+#include <QHash>
+#include <QPair>
+
+#include "csvimportwriter.h"
+
+class QSqlQuery;
+
+// Writes Insert, Append and Upsert batches as a single multi-row VALUES statement.
+class CSVValuesWriter : public CSVImportWriter
+{
+  public:
+    static const int DefaultBatchSize = 500;
+    static const int MaxParameters    = 65535;
+
+    CSVValuesWriter(CSVImportPlan *plan, int batchSize = 0);
+    virtual ~CSVValuesWriter();
+
+  protected:
+    virtual bool writeBatch(const QList<CSVImportRow> &rows, QString *errmsg);
+    virtual bool rowSavepoints() const;
+    virtual void reconnected();
+    QSqlQuery   *statement(const QBitArray &omitted, int rows, QString *errmsg);
+
+    QHash<QPair<QBitArray, int>, QSqlQuery*> _statements;
+};
+
+#endif
@@ -21,7 +21,7 @@ win32-x-g++ {
   CONFIG += shared
 }
 
-QT += sql xml xmlpatterns widgets printsupport
+QT += sql xml xmlpatterns widgets printsupport concurrent
 
 include(../global.pri)
 
@@ -35,7 +35,12 @@ win32:INCLUDEPATH += .
 DEPENDPATH  += $${INCLUDEPATH}
 
 QMAKE_LIBDIR = $${OPENRPT_LIBDIR} $$QMAKE_LIBDIR
-LIBS += -lopenrptcommon -lMetaSQL
+LIBS += -lopenrptcommon -lMetaSQL -lz -lpq
+
+PG_INCLUDEDIR = $$system(pg_config --includedir)
+PG_LIBDIR     = $$system(pg_config --libdir)
+! isEmpty( PG_INCLUDEDIR ) { INCLUDEPATH  += $${PG_INCLUDEDIR} }
+! isEmpty( PG_LIBDIR )     { QMAKE_LIBDIR += $${PG_LIBDIR}     }
 
 win32-msvc* {
   PRE_TARGETDEPS += $${OPENRPT_LIBDIR}/openrptcommon.$${LIBEXT} \
@@ -55,34 +60,62 @@ FORMS    = csvaddmapinputdialog.ui \
 
 HEADERS  = batchmessagehandler.h        \
            csvaddmapinputdialog.h       \
+           csvarraywriter.h             \
            csvimpplugin.h               \
            csvatlas.h                   \
            csvatlaslist.h               \
            csvatlaswindow.h             \
+           csvattachmentloader.h        \
+           csvbinarycopywriter.h        \
+           csvcheckpoint.h              \
+           csvcopywriter.h              \
            csvdata.h                    \
+           csvimportpipeline.h          \
+           csvimportplan.h              \
+           csvimportwriter.h            \
            csvmap.h                     \
+           csvparallelwriter.h          \
+           csvpipelinewriter.h          \
+           csvrejectwriter.h            \
+           csvstagingwriter.h           \
            csvtoolwindow.h              \
+           csvvalueswriter.h            \
            interactivemessagehandler.h  \
            logwindow.h                  \
            missingfield.h               \
            rowcontroller.h              \
+           xlsxreader.h                 \
            yabstractmessagehandler.h    \
            ../csvimpcommon/csvimpdata.h \
            ../csvimpcommon/csvimpplugininterface.h \
 
 SOURCES  = batchmessagehandler.cpp      \
            csvaddmapinputdialog.cpp     \
+           csvarraywriter.cpp           \
            csvimpplugin.cpp     \
            csvatlas.cpp         \
            csvatlaslist.cpp     \
            csvatlaswindow.cpp   \
+           csvattachmentloader.cpp \
+           csvbinarycopywriter.cpp \
+           csvcheckpoint.cpp    \
+           csvcopywriter.cpp    \
            csvdata.cpp          \
+           csvimportpipeline.cpp \
+           csvimportplan.cpp    \
+           csvimportwriter.cpp  \
            csvmap.cpp           \
+           csvparallelwriter.cpp \
+           csvpipelinewriter.cpp \
+           csvrejectwriter.cpp  \
+           csvstagingwriter.cpp \
            csvtoolwindow.cpp    \
+           csvvalueswriter.cpp  \
            interactivemessagehandler.cpp  \
            logwindow.cpp        \
            missingfield.cpp     \
            rowcontroller.cpp    \
+           xlsxreader.cpp       \
            yabstractmessagehandler.cpp    \
            ../csvimpcommon/csvimpdata.cpp \
 
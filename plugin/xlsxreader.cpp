@@ -0,0 +1,541 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#include "xlsxreader.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QIODevice>
+#include <QObject>
+#include <QRegExp>
+#include <QVector>
+#include <QXmlStreamReader>
+
+#include <zlib.h>
+
+#define DEBUG false
+
+#define ZIPCHUNKSIZE 65536
+
+static quint16 le16(const char *p)
+{
+  return (quint8)p[0] | ((quint8)p[1] << 8);
+}
+
+static quint32 le32(const char *p)
+{
+  return (quint32)le16(p) | ((quint32)le16(p + 2) << 16);
+}
+
+class XlsxZipEntry
+{
+  public:
+    quint16 method;
+    quint32 csize;
+    quint32 usize;
+    quint32 offset;
+};
+
+// inflates one member of the zip archive on demand
+class XlsxEntryStream
+{
+  public:
+    XlsxEntryStream(QIODevice *device, const XlsxZipEntry &entry)
+      : _device(device),
+        _done(false),
+        _error(false),
+        _method(entry.method),
+        _pos(0),
+        _remaining(entry.csize),
+        _size(entry.csize)
+    {
+      memset(&_zs, 0, sizeof(_zs));
+
+      char header[30];
+      if (! _device->seek(entry.offset) ||
+          _device->read(header, sizeof(header)) != (qint64)sizeof(header) ||
+          le32(header) != 0x04034b50)
+      {
+        _error = _done = true;
+        return;
+      }
+      _pos = entry.offset + sizeof(header) + le16(header + 26) + le16(header + 28);
+
+      if (_method == 8)
+        _error = _done = (inflateInit2(&_zs, -MAX_WBITS) != Z_OK);
+      else if (_method != 0)
+        _error = _done = true;
+    }
+
+    ~XlsxEntryStream()
+    {
+      if (_method == 8)
+        inflateEnd(&_zs);
+    }
+
+    bool   atEnd()    const { return _done;  }
+    qint64 consumed() const { return _size - _remaining; }
+    bool   error()    const { return _error; }
+
+    QByteArray read()
+    {
+      QByteArray out;
+      if (_done)
+        return out;
+
+      if (_method == 0)
+      {
+        _device->seek(_pos);
+        out = _device->read(qMin<qint64>(ZIPCHUNKSIZE, _remaining));
+        _pos       += out.size();
+        _remaining -= out.size();
+        _error = out.isEmpty() && _remaining > 0;
+        _done  = _error || _remaining <= 0;
+        return out;
+      }
+
+      out.resize(4 * ZIPCHUNKSIZE);
+      _zs.next_out  = (Bytef *)out.data();
+      _zs.avail_out = out.size();
+      while (_zs.avail_out > 0 && ! _done)
+      {
+        if (_zs.avail_in == 0)
+        {
+          if (_remaining <= 0)
+          {
+            _error = _done = true;  // truncated deflate stream
+            break;
+          }
+          _device->seek(_pos);
+          _in = _device->read(qMin<qint64>(ZIPCHUNKSIZE, _remaining));
+          if (_in.isEmpty())
+          {
+            _error = _done = true;
+            break;
+          }
+          _pos       += _in.size();
+          _remaining -= _in.size();
+          _zs.next_in  = (Bytef *)_in.data();
+          _zs.avail_in = _in.size();
+        }
+
+        int rc = inflate(&_zs, Z_NO_FLUSH);
+        if (rc == Z_STREAM_END)
+          _done = true;
+        else if (rc != Z_OK && rc != Z_BUF_ERROR)
+          _error = _done = true;
+      }
+      out.resize(out.size() - _zs.avail_out);
+
+      return out;
+    }
+
+  private:
+    QIODevice *_device;
+    bool       _done;
+    bool       _error;
+    QByteArray _in;
+    quint16    _method;
+    qint64     _pos;
+    qint64     _remaining;
+    qint64     _size;
+    z_stream   _zs;
+};
+
+class XlsxReaderPrivate
+{
+  public:
+    XlsxReaderPrivate(QIODevice *device)
+      : _columns(0),
+        _date1904(false),
+        _device(device),
+        _sheet(0),
+        _sheetDone(false)
+    {
+    }
+
+    ~XlsxReaderPrivate()
+    {
+      delete _sheet;
+    }
+
+    // next token from xml, inflating more of stream whenever the parser
+    // runs out of input
+    QXmlStreamReader::TokenType next(QXmlStreamReader &xml, XlsxEntryStream &stream)
+    {
+      QXmlStreamReader::TokenType token = xml.readNext();
+      while (xml.error() == QXmlStreamReader::PrematureEndOfDocumentError &&
+             ! stream.atEnd())
+      {
+        xml.addData(stream.read());
+        token = xml.readNext();
+      }
+      return token;
+    }
+
+    bool readDirectory()
+    {
+      qint64 size = _device->size();
+      qint64 tail = qMin<qint64>(size, 65536 + 22);
+      if (tail < 22 || ! _device->seek(size - tail))
+        return false;
+
+      QByteArray buf = _device->read(tail);
+      int eocd = -1;
+      for (int i = buf.size() - 22; i >= 0 && eocd < 0; i--)
+        if (le32(buf.constData() + i) == 0x06054b50)
+          eocd = i;
+      if (eocd < 0)
+        return false;
+
+      quint16 count  = le16(buf.constData() + eocd + 10);
+      quint32 dirlen = le32(buf.constData() + eocd + 12);
+      quint32 dirpos = le32(buf.constData() + eocd + 16);
+      if (dirpos == 0xffffffff || ! _device->seek(dirpos))
+        return false;     // zip64 archives are not supported
+
+      QByteArray dir = _device->read(dirlen);
+      const char *p   = dir.constData();
+      const char *end = p + dir.size();
+      for (int i = 0; i < count && p + 46 <= end; i++)
+      {
+        if (le32(p) != 0x02014b50)
+          return false;
+
+        XlsxZipEntry entry;
+        entry.method = le16(p + 10);
+        entry.csize  = le32(p + 20);
+        entry.usize  = le32(p + 24);
+        entry.offset = le32(p + 42);
+        quint16 namelen = le16(p + 28);
+        QString name = QString::fromUtf8(p + 46, qMin<int>(namelen, end - p - 46));
+        _entries.insert(name, entry);
+
+        p += 46 + namelen + le16(p + 30) + le16(p + 32);
+      }
+
+      return ! _entries.isEmpty();
+    }
+
+    // resolve the first sheet through the workbook and its relationships
+    QString firstSheet()
+    {
+      QString relid;
+      QString target;
+
+      if (_entries.contains("xl/workbook.xml"))
+      {
+        XlsxEntryStream stream(_device, _entries.value("xl/workbook.xml"));
+        QXmlStreamReader xml;
+        while (next(xml, stream) != QXmlStreamReader::EndDocument && ! xml.hasError())
+        {
+          if (! xml.isStartElement())
+            continue;
+          if (xml.name() == "workbookPr")
+          {
+            QString d1904 = xml.attributes().value("date1904").toString();
+            _date1904 = (d1904 == "1" || d1904 == "true");
+          }
+          else if (xml.name() == "sheet" && relid.isEmpty())
+            relid = xml.attributes().value("r:id").toString();
+        }
+      }
+
+      if (! relid.isEmpty() && _entries.contains("xl/_rels/workbook.xml.rels"))
+      {
+        XlsxEntryStream stream(_device, _entries.value("xl/_rels/workbook.xml.rels"));
+        QXmlStreamReader xml;
+        while (next(xml, stream) != QXmlStreamReader::EndDocument && ! xml.hasError())
+        {
+          if (xml.isStartElement() && xml.name() == "Relationship" &&
+              xml.attributes().value("Id") == relid)
+          {
+            target = xml.attributes().value("Target").toString();
+            break;
+          }
+        }
+      }
+
+      if (target.startsWith("/"))
+        target = target.mid(1);
+      else if (! target.isEmpty())
+        target = "xl/" + target;
+
+      if (target.isEmpty() || ! _entries.contains(target))
+        target = "xl/worksheets/sheet1.xml";
+
+      return target;
+    }
+
+    void loadSharedStrings()
+    {
+      if (! _entries.contains("xl/sharedStrings.xml"))
+        return;
+
+      XlsxEntryStream stream(_device, _entries.value("xl/sharedStrings.xml"));
+      QXmlStreamReader xml;
+      QString text;
+      bool    inText   = false;
+      int     phonetic = 0;
+      while (next(xml, stream) != QXmlStreamReader::EndDocument && ! xml.hasError())
+      {
+        if (xml.isStartElement())
+        {
+          if (xml.name() == "si")
+            text.clear();
+          else if (xml.name() == "rPh")
+            phonetic++;
+          else if (xml.name() == "t")
+            inText = ! phonetic;
+        }
+        else if (xml.isCharacters() && inText)
+          text += xml.text();
+        else if (xml.isEndElement())
+        {
+          if (xml.name() == "si")
+            _strings.append(text);
+          else if (xml.name() == "rPh")
+            phonetic--;
+          else if (xml.name() == "t")
+            inText = false;
+        }
+      }
+    }
+
+    // number formats that Excel renders as dates or times
+    void loadStyles()
+    {
+      if (! _entries.contains("xl/styles.xml"))
+        return;
+
+      XlsxEntryStream stream(_device, _entries.value("xl/styles.xml"));
+      QXmlStreamReader xml;
+      QHash<int, bool> customIsDate;
+      bool inCellXfs = false;
+      while (next(xml, stream) != QXmlStreamReader::EndDocument && ! xml.hasError())
+      {
+        if (xml.isStartElement())
+        {
+          if (xml.name() == "numFmt")
+          {
+            QString code = xml.attributes().value("formatCode").toString();
+            code.remove(QRegExp("\"[^\"]*\"|\\[[^\\]]*\\]|\\\\."));
+            customIsDate.insert(xml.attributes().value("numFmtId").toString().toInt(),
+                                code.contains(QRegExp("[dmyhsDMYHS]")));
+          }
+          else if (xml.name() == "cellXfs")
+            inCellXfs = true;
+          else if (xml.name() == "xf" && inCellXfs)
+          {
+            int id = xml.attributes().value("numFmtId").toString().toInt();
+            _dateStyles.append(customIsDate.contains(id) ? customIsDate.value(id)
+                               : ((id >= 14 && id <= 22) || (id >= 27 && id <= 36) ||
+                                  (id >= 45 && id <= 47) || (id >= 50 && id <= 58)));
+          }
+        }
+        else if (xml.isEndElement() && xml.name() == "cellXfs")
+          inCellXfs = false;
+      }
+    }
+
+    QString serialToDate(const QString &value) const
+    {
+      bool   ok = false;
+      double serial = value.toDouble(&ok);
+      if (! ok || serial < 0)
+        return value;
+
+      // the 1900 system counts Excel's phantom 1900-02-29
+      QDate epoch = _date1904 ? QDate(1904, 1, 1) : QDate(1899, 12, 30);
+      double days = (! _date1904 && serial < 61) ? serial + 1 : serial;
+      qint64 msecs = qRound64(days * 86400000.0);
+      QDateTime dt = QDateTime(epoch, QTime(0, 0), Qt::UTC).addMSecs(msecs);
+
+      if (serial < 1)
+        return dt.time().toString("hh:mm:ss");
+      else if (msecs % 86400000 == 0)
+        return dt.date().toString(Qt::ISODate);
+      return dt.toString("yyyy-MM-dd hh:mm:ss");
+    }
+
+    static int columnIndex(const QStringRef &ref)
+    {
+      int n = 0;
+      for (int i = 0; i < ref.size() && ref.at(i).isLetter(); i++)
+        n = n * 26 + (ref.at(i).toUpper().unicode() - 'A' + 1);
+      return n - 1;
+    }
+
+    int                    _columns;
+    bool                   _date1904;
+    QVector<bool>          _dateStyles;
+    QIODevice             *_device;
+    QHash<QString, XlsxZipEntry> _entries;
+    QString                _error;
+    XlsxEntryStream       *_sheet;
+    bool                   _sheetDone;
+    QStringList            _strings;
+    QXmlStreamReader       _xml;
+};
+
+XlsxReader::XlsxReader(QIODevice *device)
+{
+  _data = new XlsxReaderPrivate(device);
+}
+
+XlsxReader::~XlsxReader()
+{
+  delete _data;
+}
+
+int XlsxReader::columns() const
+{
+  return _data->_columns;
+}
+
+QString XlsxReader::errorString() const
+{
+  return _data->_error;
+}
+
+bool XlsxReader::open()
+{
+  if (! _data->readDirectory())
+  {
+    _data->_error = QObject::tr("The file is not a valid xlsx workbook.");
+    return false;
+  }
+
+  QString sheet = _data->firstSheet();
+  if (! _data->_entries.contains(sheet))
+  {
+    _data->_error = QObject::tr("The workbook does not contain a worksheet.");
+    return false;
+  }
+
+  _data->loadSharedStrings();
+  _data->loadStyles();
+  _data->_sheet = new XlsxEntryStream(_data->_device, _data->_entries.value(sheet));
+  if (_data->_sheet->error())
+  {
+    _data->_error = QObject::tr("Could not read %1 from the workbook.").arg(sheet);
+    return false;
+  }
+
+  if (DEBUG)
+    qDebug("XlsxReader::open() found %s with %d shared strings",
+           qPrintable(sheet), _data->_strings.size());
+
+  return true;
+}
+
+qint64 XlsxReader::pos() const
+{
+  return _data->_sheet ? _data->_sheet->consumed() : 0;
+}
+
+qint64 XlsxReader::size() const
+{
+  return _data->_device->size();
+}
+
+/* Return the next row of the sheet in row. Cells that are not in the sheet
+   come back as null strings. Returns false at the end of the sheet or on
+   error, in which case errorString() is set.
+ */
+bool XlsxReader::readRow(QStringList &row)
+{
+  if (! _data->_sheet || _data->_sheetDone)
+    return false;
+
+  QXmlStreamReader &xml = _data->_xml;
+  bool    inRow   = false;
+  bool    inValue = false;
+  int     col     = -1;
+  int     style   = 0;
+  QString type;
+  QString text;
+
+  row.clear();
+  while (true)
+  {
+    QXmlStreamReader::TokenType token = _data->next(xml, *_data->_sheet);
+    if (xml.hasError() || token == QXmlStreamReader::EndDocument)
+      break;
+
+    if (token == QXmlStreamReader::StartElement)
+    {
+      if (xml.name() == "dimension")
+      {
+        QString ref = xml.attributes().value("ref").toString();
+        int colon = ref.indexOf(':');
+        if (colon >= 0)
+          _data->_columns = XlsxReaderPrivate::columnIndex(ref.midRef(colon + 1)) + 1;
+      }
+      else if (xml.name() == "row")
+        inRow = true;
+      else if (xml.name() == "c" && inRow)
+      {
+        QXmlStreamAttributes attrs = xml.attributes();
+        QStringRef ref = attrs.value("r");
+        col   = ref.isEmpty() ? col + 1 : XlsxReaderPrivate::columnIndex(ref);
+        type  = attrs.value("t").toString();
+        style = attrs.value("s").toString().toInt();
+        text  = QString {};
+      }
+      else if ((xml.name() == "v" || xml.name() == "t") && col >= 0)
+        inValue = true;
+    }
+    else if (token == QXmlStreamReader::Characters && inValue)
+      text += xml.text();
+    else if (token == QXmlStreamReader::EndElement)
+    {
+      if (xml.name() == "v" || xml.name() == "t")
+        inValue = false;
+      else if (xml.name() == "c" && col >= 0)
+      {
+        QString value;
+        if (type == "s")
+          value = _data->_strings.value(text.toInt());
+        else if (type == "b")
+          value = (text == "1") ? "true" : "false";
+        else if (type.isEmpty() || type == "n")
+        {
+          if (style < _data->_dateStyles.size() && _data->_dateStyles.at(style))
+            value = _data->serialToDate(text);
+          else
+            value = text;
+        }
+        else
+          value = text;   // inlineStr, str and e
+
+        while (row.size() < col)
+          row.append(QString {});
+        row.append(value.isEmpty() ? QString {} : value);
+      }
+      else if (xml.name() == "row")
+      {
+        while (row.size() < _data->_columns)
+          row.append(QString {});
+        return true;
+      }
+      else if (xml.name() == "sheetData")
+        break;
+    }
+  }
+
+  _data->_sheetDone = true;
+  if (xml.hasError() || _data->_sheet->error())
+    _data->_error = QObject::tr("Error reading the worksheet: %1")
+                      .arg(xml.hasError() ? xml.errorString()
+                                          : QObject::tr("corrupt archive"));
+
+  return false;
+}
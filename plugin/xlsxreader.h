@@ -0,0 +1,41 @@
+/*
+ * This file is part of the xTuple ERP: PostBooks Edition, a free and
+ * open source Enterprise Resource Planning software suite,
+ * Copyright (c) 1999-2018 by OpenMFG LLC, d/b/a xTuple.
+ * It is licensed to you under the Common Public Attribution License
+ * version 1.0, the full text of which (including xTuple-specific Exhibits)
+ * is available at www.xtuple.com/CPAL.  By using this software, you agree
+ * to be bound by its terms.
+ */
+
+#ifndef __XLSXREADER_H__
+#define __XLSXREADER_H__
+
+#include <QString>
+#include <QStringList>
+
+class QIODevice;
+class XlsxReaderPrivate;
+
+// Pull-style reader for the first worksheet of an .xlsx workbook.
+// The sheet is inflated and parsed a chunk at a time, so memory use does
+// not depend on the size of the sheet. Only the shared strings table is
+// held in memory.
+class XlsxReader
+{
+  public:
+    XlsxReader(QIODevice *device);
+    virtual ~XlsxReader();
+
+    int     columns()     const;
+    QString errorString() const;
+    bool    open();
+    qint64  pos()         const;
+    bool    readRow(QStringList &row);
+    qint64  size()        const;
+
+  protected:
+    XlsxReaderPrivate *_data;
+};
+
+#endif
@@ -8,6 +8,8 @@ Source: https://github.com/xtuple/csvimp/archive/v%version.tar.gz
 BuildRequires: desktop-file-utils
 BuildRequires: qt-devel
 BuildRequires: xtuple-openrpt-devel
+BuildRequires: zlib-devel
+BuildRequires: postgresql-devel
 
 %global _docdir_fmt %{name}
 